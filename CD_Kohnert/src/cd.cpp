@@ -1,106 +1,584 @@
 #include <iostream>
 #include <iomanip>
+#include <stdexcept>
+#include <string>
 #include <numeric>
+#include <algorithm>
 #include <array>
 
 #define _USE_MATH_DEFINES
 #include <cmath>
 
 #include "cd.hpp"
-#include "signedarray.hpp"
+#include "integrator.hpp"
+#include "lazy_flux.hpp"
+#include "../../common/trace.hpp"
 
 //-----------------------------------------------------------------
 // Simulation Functions
 //-----------------------------------------------------------------
 
+void Species::resize(int max_size)
+{
+  C.resize(max_size);
+  g.resize(max_size);
+  D.resize(max_size);
+  K.resize(max_size);
+  r.resize(max_size);
+  r_s.resize(max_size);
+}
+
+CDState::CDState(int max_size)
+  : max_size(max_size), groups(max_size), state_size(groups.StateSize()),
+    prev_C(state_size), dissociation_rates(state_size), integrator(std::make_unique<ForwardEuler>())
+{
+  species.resize(state_size);
+  Partition();
+}
+
+CDState::CDState(int max_size, int group_threshold, double group_growth)
+  : max_size(max_size), groups(group_threshold, max_size, group_growth), state_size(groups.StateSize()),
+    prev_C(state_size), dissociation_rates(state_size), integrator(std::make_unique<ForwardEuler>())
+{
+  species.resize(state_size);
+  Partition();
+}
+
+CDState::~CDState() = default;
+
 void CDState::PrintReactionRates() {
   std::cerr << "\n[\n";
-  for (int i = -MAX_SIZE; i < MAX_SIZE; ++i) {
-    for (int j = -MAX_SIZE; j < MAX_SIZE; ++j) {
-      std::cerr << std::setfill(' ') << std::setw(10) << reaction_rates[i][j] << ", ";
+  for (int j = -state_size; j <= state_size; ++j) {
+    for (int e = reactions.row_start[j + state_size]; e < reactions.row_start[j + state_size + 1]; ++e) {
+      std::cerr << std::setfill(' ') << std::setw(4) << j << " + " << std::setw(4) << reactions.partner[e] << ": " << std::setw(10) << reactions.rate[e] << "\n";
     }
-    std::cerr << "\n";
   }
   std::cerr << "]\n";
 }
 
+double CDState::PairRate(int j, int k) const
+{
+  const double r_jk = species.r[j] + species.r[k];
+  if (j == k) return 4 * M_PI * r_jk * species.D[j];
+  return 4 * M_PI * r_jk * (species.D[j] + species.D[k]);
+}
+
 void CDState::Init()
 {
-  // Based on the example case in section 4.4 of the Kohnert paper
+  // Based on the example case in section 4.4 of the Kohnert paper, with its material by default
+  if (const char* missing = material.Missing(MATERIAL_FIELDS)) throw std::invalid_argument(std::string("The material has no ") + missing);
+  atomic_volume = material.atomic_volume * NM3_PER_CM3;
+  D_0i = material.D_0i * NM2_PER_CM2;
+  D_0v = material.D_0v * NM2_PER_CM2;
 
-  species[1].D = std::pow(10, 11) * std::exp(-E_mi / (k * T));
-  species[-1].D = std::pow(10, 11) * std::exp(-E_mv / (k * T));
+  interstitial_migration = ArrheniusTable::Get(material.E_mi, k);
+  vacancy_migration = ArrheniusTable::Get(material.E_mv, k);
 
-  for (int i = -MAX_SIZE; i < MAX_SIZE; ++i) {
+  const int discrete_size = groups.threshold;
+  for (int i = -discrete_size; i <= discrete_size; ++i) {
     if (i == 0) continue;
 
-    species[i].r = std::cbrt(3 * std::abs(i) * atomic_volume / (4 * M_PI)); // TODO - Should we really assume all clusters are spherical?
+    species.r[i] = std::cbrt(3 * std::abs(i) * atomic_volume / (4 * M_PI)); // TODO - Should we really assume all clusters are spherical?
+  }
+
+  for (int g = 0; g < groups.size(); ++g) // A group reacts with the radius of its mean size
+  {
+    const double r = std::cbrt(3 * groups.groups[g].mean * atomic_volume / (4 * M_PI));
+    species.r[groups.M0(g, 1)] = r;
+    species.r[groups.M0(g, -1)] = r;
+  }
+
+  binding.assign(2 * discrete_size + 1, nullptr);
+  for (int i = -discrete_size; i <= discrete_size; ++i) {
+    if (i == 0) continue;
+
+    double E_b = material.E_b_0 - material.E_b_capillary * (std::pow(i, 2/3) - std::pow(i-1, 2/3)); // TODO - this is only really correct for vacancies
+    binding[i + discrete_size] = ArrheniusTable::Get(E_b, k);
+  }
+
+  SetDoseRate(dose_rate);
+  species.r_s[1] = material.r_is * NM_PER_CM;
+  species.r_s[-1] = material.r_vs * NM_PER_CM;
 
-    for (int j = -MAX_SIZE; j < MAX_SIZE; ++j) { // Calculate reaction rate coefficients
-      if (j == 0) continue;
+  reactions.row_start.assign(1, 0);
+  reactions.partner.clear();
+  reactions.rate.clear();
+  UpdateRates();
 
-      if (i + j < MAX_SIZE && i + j > -MAX_SIZE) {
-        const double r_ij = species[i].r + species[j].r;
-        reaction_rates[i][j] = 4 * M_PI * r_ij * species[i].D;
-        reaction_rates[j][i] = 4 * M_PI * r_ij * species[j].D;
+  if (!groups.empty()) {
+    for (int j = -discrete_size; j <= discrete_size; ++j) {
+      if (std::abs(j) > 1 && species.D[j] != 0.0) throw std::logic_error("Size groups only support mobile point defects");
+    }
+  }
+
+  // Only pairs with a mobile member react, so the list is built from the mobile species alone.
+  // Reactions with a group, or whose product falls in one, are handled by ForEachGroupFlux.
+  for (int j = -state_size; j <= state_size; ++j)
+  {
+    if (j != 0 && species.D[j] != 0.0) {
+      for (int k = -discrete_size; k <= discrete_size; ++k)
+      {
+        if (k == 0 || std::abs(j + k) > discrete_size) continue;
+        if (species.D[k] != 0.0 && k < j) continue; // Mobile pair, listed in row k
+
+        reactions.partner.push_back(k);
+        reactions.rate.push_back(PairRate(j, k));
       }
     }
+    reactions.row_start.push_back(reactions.partner.size());
+  }
+  
+  prev_C.set(species.C);
+  if (groups.empty()) BuildSums();
+  Partition();
+}
+
+void CDState::BuildSums()
+{
+  // The terms of each size in list order, as (e or ~e, 3 e + which of j, k and j + k they are)
+  std::vector<std::vector<std::pair<int, int>>> terms(2 * state_size + 1);
+  sums.row.resize(reactions.partner.size());
+  for (int j = -state_size; j <= state_size; ++j)
+  {
+    for (int e = reactions.row_start[j + state_size]; e < reactions.row_start[j + state_size + 1]; ++e)
+    {
+      const int k = reactions.partner[e];
+      sums.row[e] = j;
+      terms[j + state_size].emplace_back(~e, 3 * e);
+      terms[k + state_size].emplace_back(~e, 3 * e + 1);
+      if (j + k != 0) terms[j + k + state_size].emplace_back(e, 3 * e + 2);
+    }
+  }
+
+  sums.block_start.assign(1, 0);
+  sums.term_start.assign(1, 0);
+  sums.term.clear();
+  std::vector<int> term_block(3 * reactions.partner.size(), -1);
+  for (const std::vector<std::pair<int, int>>& size_terms : terms)
+  {
+    for (size_t t = 0; t < size_terms.size(); ++t)
+    {
+      if (t % SUM_BLOCK == 0 && t > 0) sums.term_start.push_back(sums.term.size());
+      sums.term.push_back(size_terms[t].first);
+      term_block[size_terms[t].second] = sums.term_start.size() - 1;
+    }
+    if (!size_terms.empty()) sums.term_start.push_back(sums.term.size());
+    if (size_terms.size() > SUM_BLOCK) sums.split = true;
+    sums.block_start.push_back(sums.term_start.size() - 1);
+  }
+
+  sums.block.resize(reactions.partner.size());
+  for (size_t e = 0; e < sums.block.size(); ++e)
+  {
+    for (int slot = 0; slot < 3; ++slot) sums.block[e][slot] = term_block[3 * e + slot] < 0 ? sums.NumBlocks() : term_block[3 * e + slot];
+  }
+}
+
+void CDState::SetThreads(unsigned threads)
+{
+  pool = threads > 1 ? std::make_unique<ForkJoinPool>(threads) : nullptr;
+  Partition();
+}
+
+void CDState::Partition()
+{
+  const unsigned parts = Threads();
+  const int blocks = std::max(0, sums.NumBlocks());
+  const int terms = sums.term.size();
+
+  // Blocks are split by their number of terms, as those of the point defects are much longer
+  auto first_block = [&](unsigned part) {
+    if (part >= parts) return blocks;
+    const long long target = static_cast<long long>(terms) * part / parts;
+    return static_cast<int>(std::lower_bound(sums.term_start.begin(), sums.term_start.begin() + blocks, target) - sums.term_start.begin());
+  };
+
+  size_parts.resize(parts);
+  reaction_parts.resize(parts);
+  block_parts.resize(parts);
+  for (unsigned part = 0; part < parts; ++part)
+  {
+    size_parts[part] = ForkJoinPool::Block(-state_size, state_size + 1, part, parts);
+    reaction_parts[part] = ForkJoinPool::Block(0, reactions.partner.size(), part, parts);
+    block_parts[part] = {first_block(part), first_block(part + 1)};
+  }
+
+  flux.resize(pool ? reactions.partner.size() : 0);
+  partial.resize(blocks + 1); // And the block annihilations are added to when serial
+  if (!pool) return;
+
+  for (Concentrations* a : {&species.C, &species.g, &species.K, &prev_C}) Distribute(*a);
+  FirstTouch(flux, *pool, [&](unsigned part) { return reaction_parts[part]; });
+  FirstTouch(partial, *pool, [&](unsigned part) { return block_parts[part]; });
+  if (blocks > 0) {
+    FirstTouch(sums.term, *pool, [&](unsigned part) { return std::make_pair(sums.term_start[block_parts[part].first], sums.term_start[block_parts[part].second]); });
+  }
+}
+
+void CDState::Distribute(Concentrations& a) const
+{
+  if (!pool) return;
+
+  Concentrations moved = Concentrations::Untouched(a.size());
+  ForEachBlock([&](int lo, int hi) { std::copy(&a[lo], &a[lo] + (hi - lo), &moved[lo]); });
+  a = std::move(moved);
+}
+
+void CDState::SetLazyFlux(double rtol)
+{
+  lazy = rtol > 0.0 ? std::make_unique<LazyFlux>(rtol) : nullptr;
+}
+
+void CDState::SetTemperature(double T)
+{
+  this->T = T;
+  UpdateRates();
+}
+
+void CDState::SetDoseRate(double dose_rate)
+{
+  this->dose_rate = dose_rate;
+  species.g[1] = 1000 * dose_rate;
+  species.g[-1] = 0.01 * dose_rate;
+}
+
+void CDState::UpdateRates()
+{
+  species.D[1] = D_0i * (*interstitial_migration)(T);
+  species.D[-1] = D_0v * (*vacancy_migration)(T);
+
+  const int discrete_size = groups.threshold;
+  for (int i = -discrete_size; i <= discrete_size; ++i) {
+    if (i == 0) continue;
 
-    double E_b = 1.73 - 2.59 * (std::pow(i, 2/3) - std::pow(i-1, 2/3)); // TODO - this is only really correct for vacancies
     int dissociation_direction = i > 0 ? -1 : 1;
-    dissociation_rates[i][i + dissociation_direction] = ((reaction_rates[i][i + dissociation_direction] + reaction_rates[i + dissociation_direction][i]) / atomic_volume) * std::exp(-E_b / (k * T));
+    dissociation_rates[i] = (PairRate(i, i + dissociation_direction) / atomic_volume) * (*binding[i + discrete_size])(T);
   }
 
-  species[1].g = 1000;
-  species[1].r_s = std::pow(10, 3);
-  species[1].K = 4 * M_PI * species[1].r_s * species[1].D;
+  species.K[1] = 4 * M_PI * species.r_s[1] * species.D[1];
+  species.K[-1] = 4 * M_PI * species.r_s[-1] * species.D[-1];
 
-  species[-1].g = 0.01;
-  species[-1].r_s = std::pow(10, 3);
-  species[-1].K = 4 * M_PI * species[1].r_s * species[1].D;
-  
-  prev_species.set(species);
+  // Reaction rates only depend on T through D, the list itself stays as Init built it
+  for (size_t row = 0; row + 1 < reactions.row_start.size(); ++row)
+  {
+    const int j = static_cast<int>(row) - state_size;
+    for (int e = reactions.row_start[row]; e < reactions.row_start[row + 1]; ++e) {
+      reactions.rate[e] = PairRate(j, reactions.partner[e]);
+    }
+  }
+  if (lazy) lazy->Invalidate();
 }
 
-double CDState::GetReactionRate(int i) {
-    double j_plus_k_equals_i = 0.0; // Run through all reactions that can create i
-    for (int j = -MAX_SIZE; j <= MAX_SIZE; ++j)
+template <typename Visit>
+void CDState::ForEachGroupFlux(const Concentrations& C, Visit&& visit) const
+{
+  if (groups.empty()) return;
+
+  const int last = groups.size() - 1;
+  for (int s : {1, -1}) // Interstitial groups grow by absorbing interstitials, vacancy groups by vacancies
+  {
+    // A cluster of size n in group g counts 1 towards its M0 and Moment(n) towards its M1, and
+    // each flux below moves the clusters it acts on by one size
+
+    // Discrete clusters at the threshold grow into the first group
+    const int edge = s * groups.threshold;
+    const SizeGroups::Group& first = groups.groups[0];
+    visit(GroupFlux{PairRate(s, edge), s, edge, edge, 1.0, 0.0, 4, {s, edge, groups.M0(0, s), groups.M1(0, s)}, {-1.0, -1.0, 1.0, first.Moment(first.lo)}});
+
+    for (int g = 0; g <= last; ++g)
     {
-      if (j == 0 || j == i) continue;
-      double k = i - j;
-      if (k < -MAX_SIZE || k > MAX_SIZE) continue;
-      j_plus_k_equals_i += reaction_rates[j][k] * species[j].C * species[k].C;
+      const SizeGroups::Group& group = groups.groups[g];
+      const int m0 = groups.M0(g, s);
+      const int m1 = groups.M1(g, s);
+
+      // Linear reconstruction at the group's edges, treated as zero where it goes negative
+      double lo0, lo1, hi0, hi1;
+      groups.Reconstruction(g, group.lo, lo0, lo1);
+      groups.Reconstruction(g, group.hi, hi0, hi1);
+      if (lo0 * C[m0] + lo1 * C[m1] < 0.0) lo0 = lo1 = 0.0;
+      if (hi0 * C[m0] + hi1 * C[m1] < 0.0) hi0 = hi1 = 0.0;
+
+      // Growth by one, every member gains a defect and those at hi move into the next group
+      const double grow_rate = PairRate(s, m0);
+      if (g < last)
+      {
+        const SizeGroups::Group& next = groups.groups[g + 1];
+        visit(GroupFlux{grow_rate, s, m0, m0, 1.0, 0.0, 2, {s, m1}, {-1.0, 1.0 / group.scale}});
+        visit(GroupFlux{grow_rate, s, m0, m1, hi0, hi1, 4, {m0, m1, groups.M0(g + 1, s), groups.M1(g + 1, s)}, {-1.0, -group.Moment(group.hi + 1), 1.0, next.Moment(next.lo)}});
+      }
+      else if (group.hi > group.lo)
+      {
+        // The largest size can't grow, as in the ungrouped reaction list. M0 - M1 of the group can,
+        // which falls to zero as its mass piles up at hi, capped at M0.
+        if (C[m1] < 0.0) visit(GroupFlux{grow_rate, s, m0, m0, 1.0, 0.0, 2, {s, m1}, {-1.0, 1.0 / group.scale}});
+        else visit(GroupFlux{grow_rate, s, m0, m1, 1.0, -1.0, 2, {s, m1}, {-1.0, 1.0 / group.scale}});
+      }
+
+      // Shrinking by one through the opposite point defect, members at lo move to the group below
+      // or back to the discrete sizes
+      const double shrink_rate = PairRate(-s, m0);
+      visit(GroupFlux{shrink_rate, -s, m0, m0, 1.0, 0.0, 2, {-s, m1}, {-1.0, -1.0 / group.scale}});
+      if (g > 0)
+      {
+        const SizeGroups::Group& prev = groups.groups[g - 1];
+        visit(GroupFlux{shrink_rate, -s, m0, m1, lo0, lo1, 4, {m0, m1, groups.M0(g - 1, s), groups.M1(g - 1, s)}, {-1.0, -group.Moment(group.lo - 1), 1.0, prev.Moment(prev.hi)}});
+      }
+      else
+      {
+        visit(GroupFlux{shrink_rate, -s, m0, m1, lo0, lo1, 3, {m0, m1, edge}, {-1.0, -group.Moment(group.lo - 1), 1.0}});
+      }
     }
+  }
+}
 
-    double i_plus_j_equals_k = 0.0; // Run through all reactions that can be created using i
-    for (int j = -MAX_SIZE; j <= MAX_SIZE; ++j)
+void CDState::SumReactions(const Concentrations& C, Concentrations& R) const
+{
+  if (!pool)
+  {
+    // Serially it's faster to add each flux to its blocks as it's computed, which sums every block's
+    // terms in the same order
+    std::fill(partial.begin(), partial.end(), 0.0);
+    for (int j = -state_size; j <= state_size; ++j)
     {
-      if (j == 0) continue;
-      double k = i + j;
-      if (k < -MAX_SIZE || k > MAX_SIZE) continue;
-      i_plus_j_equals_k -= reaction_rates[i][j] * species[i].C * species[j].C;
+      const double C_j = C[j];
+      const int end = reactions.row_start[j + state_size + 1];
+      for (int e = reactions.row_start[j + state_size]; e < end; ++e)
+      {
+        const double flux = reactions.rate[e] * C_j * C[reactions.partner[e]];
+        const std::array<int, 3>& block = sums.block[e];
+        partial[block[0]] -= flux;
+        partial[block[1]] -= flux;
+        partial[block[2]] += flux;
+      }
     }
+  }
+  else
+  {
+    // Every flux, then the terms of every block
+    RunParts([&](unsigned part) {
+    for (int e = reaction_parts[part].first; e < reaction_parts[part].second; ++e) {
+        flux[e] = reactions.rate[e] * C[sums.row[e]] * C[reactions.partner[e]];
+      }
+    });
 
-    double combination_rate = j_plus_k_equals_i - i_plus_j_equals_k;
-    double dissociation_rate = 0.0; // TODO
+    RunParts([&](unsigned part) {
+      for (int b = block_parts[part].first; b < block_parts[part].second; ++b)
+      {
+        double sum = 0.0;
+        for (int t = sums.term_start[b]; t < sums.term_start[b + 1]; ++t)
+        {
+          const int e = sums.term[t];
+          sum = e >= 0 ? sum + flux[e] : sum - flux[~e];
+        }
+        partial[b] = sum;
+      }
+    });
+  }
 
-    return combination_rate + dissociation_rate;
+  // Then the blocks of every size
+  ForEachBlock([&](int lo, int hi) {
+    for (int i = lo; i < hi; ++i)
+    {
+      const int first = sums.block_start[i + state_size], last = sums.block_start[i + state_size + 1];
+      double sum = first < last ? partial[first] : 0.0;
+      for (int b = first + 1; b < last; ++b) sum += partial[b];
+      R[i] = sum;
+    }
+  });
 }
 
-void CDState::Step(double dt)
+void CDState::GetReactionRates(const Concentrations& C, Concentrations& R) const
 {
-  for (int i = -MAX_SIZE; i <= MAX_SIZE; ++i) // Compute the change in concentration for each cluster species
+  // With one block per size, adding each flux straight to R sums in the same order
+  if (lazy) lazy->ReactionRates(*this, C, R);
+  else if (groups.empty() && (pool || sums.split)) SumReactions(C, R);
+  else
+  {
+    R.fill(0.0);
+
+    for (int j = -state_size; j <= state_size; ++j)
+    {
+      const double C_j = C[j];
+      const int end = reactions.row_start[j + state_size + 1];
+      for (int e = reactions.row_start[j + state_size]; e < end; ++e)
+      {
+        const int k = reactions.partner[e];
+        const double flux = reactions.rate[e] * C_j * C[k];
+
+        R[j] -= flux;
+        R[k] -= flux;
+        R[j + k] += flux;
+      }
+    }
+  }
+
+  ForEachGroupFlux(C, [&](const GroupFlux& f) {
+    const double flux = f.rate * C[f.mobile] * (f.c0 * C[f.x0] + f.c1 * C[f.x1]);
+    for (int t = 0; t < f.num_targets; ++t) R[f.target[t]] += f.coefficient[t] * flux;
+  });
+
+  R[0] = 0.0; // Annihilation of an interstitial and vacancy cluster of the same size
+  // TODO - dissociation
+
+  MMD_TRACE_RESIDUAL("reaction defect balance", DefectCount(R)); // Reactions neither make nor destroy defects
+}
+
+double CDState::DefectCount(const Concentrations& C) const
+{
+  double count = 0.0;
+  for (int i = -groups.threshold; i <= groups.threshold; ++i) count += i * C[i];
+  for (int g = 0; g < groups.size(); ++g)
+  {
+    const SizeGroups::Group& group = groups.groups[g];
+    for (int s : {1, -1}) count += s * (group.mean * C[groups.M0(g, s)] + group.scale * C[groups.M1(g, s)]);
+  }
+  return count;
+}
+
+void CDState::GetDerivatives(const Concentrations& C, Concentrations& dCdt) const
+{
+  MMD_TRACE_SCOPE("rates");
+  GetReactionRates(C, dCdt);
+
+  ForEachBlock([&](int lo, int hi) {
+    for (int i = lo; i < hi; ++i) // Compute the change in concentration for each cluster species
+    {
+      if (i == 0) continue;
+
+      double sink_loss = species.K[i] * C_s * C[i];
+      dCdt[i] += species.g[i] - sink_loss;
+    }
+  });
+}
+
+void CDState::GetJacobian(const Concentrations& C, Jacobian& J) const
+{
+  MMD_TRACE_SCOPE("jacobian");
+  J.Clear();
+
+  for (int j = -state_size; j <= state_size; ++j)
+  {
+    const int end = reactions.row_start[j + state_size + 1];
+    for (int e = reactions.row_start[j + state_size]; e < end; ++e)
+    {
+      const int k = reactions.partner[e];
+      const double dflux_dCj = reactions.rate[e] * C[k];
+      const double dflux_dCk = reactions.rate[e] * C[j];
+
+      J.Add(j, j, -dflux_dCj);
+      J.Add(j, k, -dflux_dCk);
+      J.Add(k, j, -dflux_dCj);
+      J.Add(k, k, -dflux_dCk);
+
+      if (j + k == 0) continue;
+      J.Add(j + k, j, dflux_dCj);
+      J.Add(j + k, k, dflux_dCk);
+    }
+  }
+
+  ForEachGroupFlux(C, [&](const GroupFlux& f) {
+    const double dflux_dmobile = f.rate * (f.c0 * C[f.x0] + f.c1 * C[f.x1]);
+    const double dflux_dx0 = f.rate * C[f.mobile] * f.c0;
+    const double dflux_dx1 = f.rate * C[f.mobile] * f.c1;
+
+    for (int t = 0; t < f.num_targets; ++t)
+    {
+      J.Add(f.target[t], f.mobile, f.coefficient[t] * dflux_dmobile);
+      J.Add(f.target[t], f.x0, f.coefficient[t] * dflux_dx0);
+      J.Add(f.target[t], f.x1, f.coefficient[t] * dflux_dx1);
+    }
+  });
+
+  for (int i = -state_size; i <= state_size; ++i)
   {
     if (i == 0) continue;
+    J.Add(i, i, -species.K[i] * C_s);
+  }
+}
+
+void CDState::InitJacobian(Jacobian& J) const
+{
+  // Every row of the reaction list is a mobile species. Its row and column go in the border, and
+  // its size bounds the distance of every other entry from the diagonal.
+  std::vector<int> border;
+  int half_width = 0;
 
-    Species& s = species[i];
+  for (int j = -state_size; j <= state_size; ++j)
+  {
+    if (reactions.row_start[j + state_size] == reactions.row_start[j + state_size + 1]) continue;
+    border.push_back(j);
+    half_width = std::max(half_width, std::abs(j));
+  }
 
-    double R = GetReactionRate(i);
-    double sink_loss = s.K * C_s * s.C;
-    double dC = dt * (s.g + R - sink_loss);
+  // A group's moments couple to those of its neighbours, at most 3 slots apart
+  if (!groups.empty()) half_width = std::max(half_width, 3);
 
-    s.C += dC;
+  J.Configure(state_size, border, half_width);
+}
+
+void CDState::GetConcentrations(Concentrations& C) const
+{
+  C.set(species.C);
+}
+
+void CDState::SetConcentrations(const Concentrations& C)
+{
+  species.C.set(C);
+  species.C[0] = 0.0;
+}
+
+void CDState::SetIntegrator(std::unique_ptr<Integrator> integrator)
+{
+  this->integrator = std::move(integrator);
+  this->integrator->SetTolerances(tolerances);
+  controller = StepController(this->integrator->ErrorOrder());
+}
+
+void CDState::SetTolerances(const Tolerances& tol)
+{
+  tolerances = tol;
+  integrator->SetTolerances(tol);
+}
+
+double CDState::Step(double dt)
+{
+  MMD_TRACE_SCOPE("update");
+  double error = integrator->Step(*this, dt);
+
+  ForEachBlock([&](int lo, int hi) { std::copy(&species.C[lo], &species.C[lo] + (hi - lo), &prev_C[lo]); });
+  MMD_TRACE_COUNT("steps", 1);
+  MMD_TRACE_CHECK_FINITE("CD_Kohnert step", species.C.data(), 2 * state_size + 1, -state_size);
+  return error;
+}
+
+double CDState::AdaptiveStep(double t, double t_end, double& dt)
+{
+  if (integrator->ErrorOrder() == 0) {
+    throw std::logic_error(std::string("Integrator ") + integrator->Name() + " has no error estimate for adaptive stepping");
   }
 
-  prev_species.set(species);
+  MMD_TRACE_SCOPE("update");
+  for (;;)
+  {
+    const bool last = t + dt >= t_end;
+    const double h = last ? t_end - t : dt;
+
+    double error = integrator->Step(*this, h);
+    double next_dt = controller.NextDt(h, error);
+
+    if (StepController::Accept(error))
+    {
+      prev_C.set(species.C);
+      MMD_TRACE_COUNT("steps", 1);
+      MMD_TRACE_CHECK_FINITE("CD_Kohnert step", species.C.data(), 2 * state_size + 1, -state_size);
+      if (!last || next_dt < dt) dt = next_dt; // Don't let a short final step shrink dt
+      return last ? t_end : t + h;
+    }
+
+    species.C.set(prev_C); // Rejected, retry from the start of the step
+    MMD_TRACE_COUNT("rejected steps", 1);
+    dt = next_dt;
+
+    if (t + dt == t) throw std::runtime_error("Adaptive step size underflow at t = " + std::to_string(t));
+  }
 }
\ No newline at end of file
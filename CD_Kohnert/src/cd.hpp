@@ -1,41 +1,214 @@
 #pragma once
 
+#include <array>
 #include <cmath>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
 
+#include "groups.hpp"
+#include "jacobian.hpp"
 #include "signedarray.hpp"
+#include "../../common/adaptive.hpp"
+#include "../../common/arrhenius.hpp"
+#include "../../common/fork_join.hpp"
+#include "../../common/material.hpp"
 
+class Integrator;
+class LazyFlux;
+
+// Per cluster size properties, one array per property indexed by signed cluster size
 struct Species
 {
-  double C = 0.0; // Concentration of this species
-  double g = 0.0; // Generation of this cluster species in collision cascades
-  double D = 0.0; // Diffusion constant
-  double K = 0.0; // Sink strength
+  SignedArray<double> C; // Concentration of this species
+  SignedArray<double> g; // Generation of this cluster species in collision cascades
+  SignedArray<double> D; // Diffusion constant
+  SignedArray<double> K; // Sink strength
   
-  double r = 0.0; // Reaction radius
-  double r_s = 0.0; // Reaction radius with sinks
+  SignedArray<double> r; // Reaction radius
+  SignedArray<double> r_s; // Reaction radius with sinks
+
+  void resize(int max_size);
 };
 
 class CDState 
 {
 public:
-  static constexpr double T = 300.0; // Temperature in Kelvin
-  static constexpr double atomic_volume = 0.0118; // Atomic volume in nm^3
-  static constexpr double C_s = 8.0 * 0.000001;
+  static constexpr double DEFAULT_T = 300.0;
+  static constexpr double DEFAULT_C_S = 8.0 * 0.000001;
+
+  // Per instance so independent runs can differ, set before Init (or T through SetTemperature after)
+  double T = DEFAULT_T; // Temperature in Kelvin
+  double C_s = DEFAULT_C_S;
+  double dose_rate = 1.0; // Relative to the nominal cascade generation, see SetDoseRate
+  Material material = KOHNERT_EXAMPLE; // In cm, converted to this model's nm by Init
+
+  // The material parameters Init reads, which the material must define
+  static constexpr std::array<double Material::*, 9> MATERIAL_FIELDS = {&Material::atomic_volume, &Material::D_0i, &Material::D_0v,
+    &Material::E_mi, &Material::E_mv, &Material::r_is, &Material::r_vs, &Material::E_b_0, &Material::E_b_capillary};
 
-  static constexpr double E_mv = 0.67; //Migration energy of point vacancies in eV
-  static constexpr double E_mi = 0.34; //Migration energy of point interstitials in eV
   static constexpr double k = 8.6173 * 0.00005; //eV K^-1 k is the Boltzmann constant
+  static constexpr double NM_PER_CM = 1e7, NM2_PER_CM2 = 1e14, NM3_PER_CM3 = 1e21;
+
+  static constexpr int DEFAULT_MAX_SIZE = 40;
+  static constexpr double DEFAULT_GROUP_GROWTH = 1.1;
+  using Concentrations = SignedArray<double>;
+
+  const int max_size; // Largest interstitial (+) and vacancy (-) cluster size tracked
+  const SizeGroups groups; // Sizes above groups.threshold, if any, are tracked as groups
+
+  // Concentrations are indexed from -state_size to state_size. This is max_size when every size
+  // is discrete, see SizeGroups for the layout otherwise.
+  const int state_size;
+
+  Species species;
+  Concentrations prev_C; // Concentrations at the start of the current step
+
+  SignedArray<double> dissociation_rates; // Rate of i emitting a point defect, moving towards size 0
 
-  static constexpr int MAX_SIZE = 40;
-  SignedArray<Species, MAX_SIZE> species{};
-  SignedArray<Species, MAX_SIZE> prev_species{};
+  // Reactions j + k -> j + k with a nonzero rate, in compressed sparse row form. Row j is a
+  // mobile species and lists its partners k, with k >= j when k is mobile too so every pair
+  // appears once. Built by Init, so a flux evaluation only visits reactions that can happen.
+  struct ReactionList
+  {
+    std::vector<int> row_start; // Indexed by j + state_size, one extra entry at the end
+    std::vector<int> partner;
+    std::vector<double> rate;
+  } reactions;
 
-  SignedArray<SignedArray<double, MAX_SIZE>, MAX_SIZE> reaction_rates;
-  SignedArray<SignedArray<double, MAX_SIZE>, MAX_SIZE> dissociation_rates;
+  // How GetReactionRates adds up the fluxes of the reaction list when there are no size groups.
+  // R[i] gets a term for each reaction i takes part in, in list order, summed in blocks of at most
+  // SUM_BLOCK terms, each from 0, and then the blocks of i are added in order. Only the point
+  // defects, which react with every size, have more than one block, and summing them in blocks
+  // splits them over threads with the same result for any number of threads.
+  static constexpr int SUM_BLOCK = 512;
+  struct ReactionSums
+  {
+    std::vector<int> row; // j of each reaction in the list
+    std::vector<int> block_start; // First block of i at i + state_size, one extra entry at the end
+    FirstTouchVector<int> term_start; // First term of each block, one extra entry at the end
+    FirstTouchVector<int> term; // Reaction e of each term, ~e if it is subtracted
+    std::vector<std::array<int, 3>> block; // Blocks reaction e adds to for j, k and j + k, an extra
+                                           // one past the last for annihilations, which have none
+    bool split = false; // Whether any size has more than one block
+    int NumBlocks() const { return static_cast<int>(term_start.size()) - 1; }
+  } sums;
+
+  explicit CDState(int max_size = DEFAULT_MAX_SIZE);
+
+  // Sizes up to group_threshold are discrete, larger ones are grouped (see SizeGroups)
+  CDState(int max_size, int group_threshold, double group_growth = DEFAULT_GROUP_GROWTH);
+  ~CDState();
 
   void Init(); // TODO - Get input parameters through here
-  void Step(double dt);
+  double Step(double dt); // Returns the integrator's error estimate, see Integrator::Step
+
+  // Splits the loops over sizes and reactions in each step over threads of a ForkJoinPool, 1 to run
+  // serially. Results are the same for any number. Best called before Init, which then places the
+  // arrays each thread works on in its own NUMA node's memory.
+  void SetThreads(unsigned threads);
+  unsigned Threads() const { return pool ? pool->size() : 1; }
+
+  // Calls body(lo, hi) for blocks of sizes [lo, hi) covering -state_size to state_size, each on
+  // the thread that owns it
+  template <typename Body>
+  void ForEachBlock(Body&& body) const
+  {
+    RunParts([&](unsigned part) { body(size_parts[part].first, size_parts[part].second); });
+  }
+
+  // Moves a to memory first touched by the thread that owns each block, see FirstTouch
+  void Distribute(Concentrations& a) const;
+
+  // Reuses each reaction flux term until its partner's concentration moves by more than rtol,
+  // see LazyFlux. 0, the default, computes every term on every call. Runs serially.
+  void SetLazyFlux(double rtol);
+  const LazyFlux* GetLazyFlux() const { return lazy.get(); } // Null unless set
+
+  // Moves an initialized state to temperature T. Rates are read from shared Arrhenius tables, so
+  // this is cheap enough to call every step to follow a temperature ramp.
+  void SetTemperature(double T);
+  void SetDoseRate(double dose_rate); // Scales the cascade generation terms
+
+  // Takes one error controlled step from t, never past t_end. dt is the step to try and is
+  // updated with the step to try next. Returns the time reached.
+  double AdaptiveStep(double t, double t_end, double& dt);
 
-  double GetReactionRate(int i);
+  // Selects how Step advances the state. Defaults to forward Euler.
+  void SetIntegrator(std::unique_ptr<Integrator> integrator);
+  const Integrator& GetIntegrator() const { return *integrator; }
+  Integrator& GetIntegrator() { return *integrator; }
+  StepController& GetController() { return controller; }
+  const StepController& GetController() const { return controller; }
+  void SetTolerances(const Tolerances& tol);
+
+  // Right hand side of the rate equations and its analytic Jacobian, both evaluated at C
+  void GetDerivatives(const Concentrations& C, Concentrations& dCdt) const;
+  void GetJacobian(const Concentrations& C, Jacobian& J) const;
+  void InitJacobian(Jacobian& J) const; // Sets up J's sparsity pattern from the reaction list
+
+  void GetConcentrations(Concentrations& C) const;
+  void SetConcentrations(const Concentrations& C);
+
+  // Net rate of change from reactions for every species, in one pass over the reaction list
+  void GetReactionRates(const Concentrations& C, Concentrations& R) const;
   void PrintReactionRates();
+
+  // Rate coefficient of j + k with both orderings combined, 4 pi (r_j + r_k) (D_j + D_k)
+  double PairRate(int j, int k) const;
+
+  // Net point defect count of C, interstitials counted positive and vacancies negative.
+  // Reactions conserve it, including those that move clusters between groups.
+  double DefectCount(const Concentrations& C) const;
+
+private:
+  // A reaction of a point defect with a size group, or one that carries a discrete cluster into a
+  // group. Its flux is rate * C[mobile] * (c0 * C[x0] + c1 * C[x1]), and it changes each
+  // C[target[t]] by coefficient[t] * flux.
+  struct GroupFlux
+  {
+    double rate;
+    int mobile;
+    int x0, x1;
+    double c0, c1;
+
+    int num_targets;
+    int target[4];
+    double coefficient[4];
+  };
+
+  template <typename Visit>
+  void ForEachGroupFlux(const Concentrations& C, Visit&& visit) const;
+
+  // From the material, in nm
+  double atomic_volume = 0.0; // nm^3
+  double D_0i = 0.0, D_0v = 0.0; // nm^2/s
+
+  // Temperature dependence, looked up rather than computed
+  std::shared_ptr<const ArrheniusTable> interstitial_migration, vacancy_migration;
+  std::vector<std::shared_ptr<const ArrheniusTable>> binding; // Indexed by size + groups.threshold
+
+  void UpdateRates(); // Every rate that depends on T: diffusion, sink strength, dissociation and reactions
+
+  std::unique_ptr<ForkJoinPool> pool; // Null when serial
+  std::vector<std::pair<int, int>> size_parts, reaction_parts, block_parts; // Range of each part
+  mutable FirstTouchVector<double> flux, partial; // Scratch for SumReactions, by reaction and block
+
+  template <typename Task>
+  void RunParts(Task&& task) const
+  {
+    if (pool) pool->Run(task);
+    else task(0u);
+  }
+
+  void BuildSums(); // From the reaction list
+  void Partition(); // Splits sizes, reactions and blocks between the threads, and places their memory
+  void SumReactions(const Concentrations& C, Concentrations& R) const; // See ReactionSums
+
+  std::unique_ptr<LazyFlux> lazy; // Null unless SetLazyFlux, updated by GetReactionRates like the scratch above
+
+  std::unique_ptr<Integrator> integrator;
+  Tolerances tolerances;
+  StepController controller;
 };
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.hpp"
+#include "integrator.hpp"
+#include "../../common/trace.hpp"
+
+static uint64_t Align(uint64_t offset)
+{
+  return (offset + 63) & ~uint64_t(63);
+}
+
+//-----------------------------------------------------------------
+// Checkpoint
+//-----------------------------------------------------------------
+
+Checkpoint Checkpoint::Capture(const CDState& cd, const RunOptions& options, const RunProgress& progress)
+{
+  Checkpoint c{}; // Value-initialized, which zeroes the header's padding too, so it is written as zeros
+  Header& h = c.header;
+
+  std::memcpy(h.magic, MAGIC, sizeof(h.magic));
+  h.version = VERSION;
+  h.header_size = sizeof(Header);
+
+  h.max_size = cd.max_size;
+  h.state_size = cd.state_size;
+  h.group_threshold = cd.groups.empty() ? 0 : cd.groups.threshold;
+  h.adaptive = options.adaptive;
+  h.group_growth = options.group_growth;
+  h.temperature = cd.T;
+  h.C_s = cd.C_s;
+  h.rtol = options.tolerances.rtol;
+  h.atol = options.tolerances.atol;
+  h.step = options.dt;
+  h.total_time = options.total_time;
+  std::strncpy(h.integrator, cd.GetIntegrator().Name(), sizeof(h.integrator) - 1);
+  h.material = cd.material;
+
+  h.t = progress.t;
+  h.dt = progress.dt;
+  h.steps = progress.steps;
+  h.controller_memory = cd.GetController().Memory();
+
+  const size_t count = 2 * cd.state_size + 1;
+  c.C.assign(cd.species.C.data(), cd.species.C.data() + count);
+  c.prev_C.assign(cd.prev_C.data(), cd.prev_C.data() + count);
+  c.history = cd.GetIntegrator().GetHistory();
+
+  h.concentration_count = count;
+  h.history_count = c.history.size();
+  h.C_offset = Align(sizeof(Header));
+  h.prev_C_offset = Align(h.C_offset + count * sizeof(double));
+  h.history_offset = Align(h.prev_C_offset + count * sizeof(double));
+  h.file_size = h.history_offset + h.history_count * sizeof(double);
+  return c;
+}
+
+void Checkpoint::Write(const std::string& path) const
+{
+  MMD_TRACE_SCOPE("checkpoint");
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.good()) throw std::runtime_error("Could not open " + temporary);
+
+    auto write_at = [&](uint64_t offset, const void* data, size_t bytes) {
+      static const char zeros[64] = {};
+      const uint64_t position = file.tellp();
+      file.write(zeros, offset - position); // Alignment padding
+      file.write(static_cast<const char*>(data), bytes);
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_at(header.C_offset, C.data(), C.size() * sizeof(double));
+    write_at(header.prev_C_offset, prev_C.data(), prev_C.size() * sizeof(double));
+    write_at(header.history_offset, history.data(), history.size() * sizeof(double));
+
+    file.flush();
+    if (!file.good()) throw std::runtime_error("Could not write " + temporary);
+  }
+
+  // Only replace the previous checkpoint once the new one is complete
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) throw std::runtime_error("Could not rename " + temporary + " to " + path);
+}
+
+std::unique_ptr<CDState> Checkpoint::Restore(const std::string& path, RunOptions& options, RunProgress& progress)
+{
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("Could not open " + path);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(Header)))
+  {
+    close(fd);
+    throw std::runtime_error(path + " is not a checkpoint");
+  }
+
+  void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) throw std::runtime_error("Could not map " + path);
+
+  struct Unmap
+  {
+    void* address;
+    size_t length;
+    ~Unmap() { munmap(address, length); }
+  } unmap{mapped, static_cast<size_t>(info.st_size)};
+
+  const char* bytes = static_cast<const char*>(mapped);
+  const Header& h = *reinterpret_cast<const Header*>(bytes);
+  if (std::memcmp(h.magic, MAGIC, sizeof(h.magic)) != 0) throw std::runtime_error(path + " is not a checkpoint");
+  if (h.version != VERSION || h.header_size != sizeof(Header)) {
+    throw std::runtime_error(path + " is checkpoint version " + std::to_string(h.version) + ", expected " + std::to_string(VERSION));
+  }
+  if (h.file_size != static_cast<uint64_t>(info.st_size)) throw std::runtime_error(path + " is truncated");
+
+  // Every array must lie past the header and within the file, at the aligned offsets Capture gives
+  const uint64_t file_size = info.st_size;
+  auto inside = [&](uint64_t offset, uint64_t count) {
+    return offset >= sizeof(Header) && offset % 64 == 0 && offset <= file_size && count <= (file_size - offset) / sizeof(double);
+  };
+  if (!inside(h.C_offset, h.concentration_count) || !inside(h.prev_C_offset, h.concentration_count) || !inside(h.history_offset, h.history_count)) {
+    throw std::runtime_error(path + " is corrupt, its arrays lie outside the file");
+  }
+
+  options.max_size = h.max_size;
+  options.group_threshold = h.group_threshold;
+  options.group_growth = h.group_growth;
+  options.adaptive = h.adaptive;
+  options.temperature = h.temperature;
+  options.C_s = h.C_s;
+  options.tolerances.rtol = h.rtol;
+  options.tolerances.atol = h.atol;
+  options.dt = h.step;
+  options.total_time = h.total_time;
+  options.integrator = std::string(h.integrator, strnlen(h.integrator, sizeof(h.integrator)));
+  options.material = h.material;
+
+  std::unique_ptr<CDState> cd = MakeState(options);
+  if (cd->state_size != h.state_size || h.concentration_count != uint64_t(2 * h.state_size + 1)) {
+    throw std::runtime_error(path + " does not match the state it describes");
+  }
+  if (!cd->GetIntegrator().ValidHistory(h.history_count, h.state_size)) {
+    throw std::runtime_error(path + " has " + std::to_string(h.history_count) + " history values, which the " + options.integrator + " integrator can't restore");
+  }
+
+  const size_t bytes_per_array = h.concentration_count * sizeof(double);
+  std::memcpy(cd->species.C.data(), bytes + h.C_offset, bytes_per_array);
+  std::memcpy(cd->prev_C.data(), bytes + h.prev_C_offset, bytes_per_array);
+  cd->GetIntegrator().SetHistory(reinterpret_cast<const double*>(bytes + h.history_offset), h.history_count);
+  cd->GetController().SetMemory(h.controller_memory);
+
+  progress.t = h.t;
+  progress.dt = h.dt;
+  progress.steps = h.steps;
+  return cd;
+}
+
+//-----------------------------------------------------------------
+// CheckpointWriter
+//-----------------------------------------------------------------
+
+CheckpointWriter::CheckpointWriter(std::string path)
+  : path(std::move(path)), thread([this] { Loop(); })
+{
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+void CheckpointWriter::Submit(Checkpoint checkpoint)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = std::make_unique<Checkpoint>(std::move(checkpoint));
+  }
+  wake.notify_one();
+}
+
+void CheckpointWriter::Loop()
+{
+  for (;;)
+  {
+    std::unique_ptr<Checkpoint> checkpoint;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this] { return stopping || pending; });
+      if (!pending) return; // Stopping with nothing left to write
+      checkpoint = std::move(pending);
+    }
+
+    try {
+      checkpoint->Write(path);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "Checkpoint failed: " << e.what() << std::endl;
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cd.hpp"
+#include "run.hpp"
+#include "../../common/aligned_allocator.hpp"
+
+// Snapshot of a run, enough to continue it exactly where it stopped.
+//
+// On disk the header below is followed by the arrays it points to, each at a 64 byte aligned
+// offset and stored as in memory (native byte order), so a restart maps the file and copies the
+// arrays straight into the state without parsing anything.
+struct Checkpoint
+{
+  static constexpr char MAGIC[8] = "MMDCKPT";
+  static constexpr uint32_t VERSION = 2;
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+
+    // Run options that shape the state
+    int32_t max_size;
+    int32_t state_size;
+    int32_t group_threshold;
+    int32_t adaptive;
+    double group_growth;
+    double temperature;
+    double C_s;
+    double rtol;
+    double atol;
+    double step; // options.dt
+    double total_time;
+    char integrator[16];
+    Material material; // Every parameter, so a restart doesn't depend on the material file
+
+    // Progress
+    double t;
+    double dt;
+    int64_t steps;
+    double controller_memory;
+
+    // Arrays, as byte offsets from the start of the file and double counts
+    uint64_t C_offset;
+    uint64_t prev_C_offset;
+    uint64_t history_offset;
+    uint64_t concentration_count;
+    uint64_t history_count;
+    uint64_t file_size;
+  } header;
+
+  AlignedVector<double> C;
+  AlignedVector<double> prev_C;
+  std::vector<double> history; // Integrator::GetHistory
+
+  // Copies what is needed from a running state. Cheap next to a step, no I/O.
+  static Checkpoint Capture(const CDState& cd, const RunOptions& options, const RunProgress& progress);
+
+  void Write(const std::string& path) const; // Writes to path.tmp, then renames over path
+
+  // Maps the checkpoint at path and restores it: options and progress come from the file, and the
+  // returned state holds its concentrations and integrator history. Throws std::runtime_error if
+  // the file is not a checkpoint of this version.
+  static std::unique_ptr<CDState> Restore(const std::string& path, RunOptions& options, RunProgress& progress);
+};
+
+// Writes checkpoints on a background thread so the step loop never waits for the disk. If
+// snapshots come faster than they can be written, only the newest one waiting is kept.
+class CheckpointWriter
+{
+public:
+  explicit CheckpointWriter(std::string path);
+  ~CheckpointWriter(); // Finishes any write in progress or waiting
+
+  void Submit(Checkpoint checkpoint); // Returns at once
+
+private:
+  const std::string path;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::unique_ptr<Checkpoint> pending;
+  bool stopping = false;
+
+  std::thread thread; // Last, so it starts after everything it uses
+
+  void Loop();
+};
\ No newline at end of file
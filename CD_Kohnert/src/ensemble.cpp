@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "ensemble.hpp"
+#include "../../common/trace.hpp"
+
+template <typename Policy>
+BasicEnsemble<Policy>::BasicEnsemble(const std::vector<const CDState*>& members)
+  : state_size(members.empty() ? 0 : members.front()->state_size), num_members(members.size())
+{
+  if (members.empty()) throw std::invalid_argument("An ensemble needs at least one member");
+
+  const CDState& first = *members.front();
+  row_start = first.reactions.row_start;
+  partner = first.reactions.partner;
+  sums = first.sums;
+
+  for (const CDState* member : members)
+  {
+    if (!member->groups.empty()) throw std::invalid_argument("Ensembles don't support size groups");
+    if (member->state_size != state_size || member->reactions.row_start != row_start || member->reactions.partner != partner) {
+      throw std::invalid_argument("Ensemble members must have the same sizes and reactions");
+    }
+  }
+
+  width = (num_members + LANES - 1) / LANES * LANES;
+  const size_t rows = 2 * static_cast<size_t>(state_size) + 1;
+  rate.assign(partner.size() * width, 0.0);
+  generation.assign(rows * width, 0.0);
+  sink.assign(rows * width, 0.0);
+  C.assign(rows * width, 0.0);
+  if (Policy::COMPENSATED) compensation.assign(rows * width, 0.0);
+  dCdt.assign(rows * width, 0.0);
+  partial.assign((sums.NumBlocks() + 1) * width, 0.0);
+
+  for (int m = 0; m < num_members; ++m)
+  {
+    UpdateRates(m, *members[m]);
+    SetConcentrations(m, members[m]->species.C);
+  }
+}
+
+template <typename Policy>
+void BasicEnsemble<Policy>::UpdateRates(int m, const CDState& member)
+{
+  for (size_t e = 0; e < partner.size(); ++e) rate[e * width + m] = member.reactions.rate[e];
+
+  for (int i = -state_size; i <= state_size; ++i)
+  {
+    generation[Row(i) + m] = member.species.g[i];
+    sink[Row(i) + m] = member.species.K[i] * member.C_s;
+  }
+}
+
+template <typename Policy>
+void BasicEnsemble<Policy>::GetConcentrations(int m, CDState::Concentrations& C) const
+{
+  if (static_cast<int>(C.size()) != state_size) C.resize(state_size);
+  for (int i = -state_size; i <= state_size; ++i)
+  {
+    C[i] = this->C[Row(i) + m];
+    if (Policy::COMPENSATED) C[i] += compensation[Row(i) + m];
+  }
+}
+
+template <typename Policy>
+void BasicEnsemble<Policy>::SetConcentrations(int m, const CDState::Concentrations& C)
+{
+  for (int i = -state_size; i <= state_size; ++i)
+  {
+    this->C[Row(i) + m] = static_cast<Storage>(C[i]);
+    if (Policy::COMPENSATED) compensation[Row(i) + m] = static_cast<Storage>(C[i] - this->C[Row(i) + m]);
+  }
+  this->C[Row(0) + m] = 0.0;
+  if (Policy::COMPENSATED) compensation[Row(0) + m] = 0.0;
+}
+
+template <typename Policy>
+void BasicEnsemble<Policy>::GetReactionRates(const Storage* C, double* R) const
+{
+  std::fill(partial.begin(), partial.end(), 0.0);
+
+  // Same reactions in the same order as CDState::GetReactionRates, a block of members at a time,
+  // each flux added to the sums it goes in (see CDState::ReactionSums). The flux goes through a
+  // local block so the updates below don't alias the inputs.
+  for (int j = -state_size; j <= state_size; ++j)
+  {
+    const Storage* C_j = C + Row(j);
+    const int end = row_start[j + state_size + 1];
+    for (int e = row_start[j + state_size]; e < end; ++e)
+    {
+      const int k = partner[e];
+      const Storage* rate_e = rate.data() + static_cast<size_t>(e) * width;
+      const Storage* C_k = C + Row(k);
+      double* R_j = partial.data() + static_cast<size_t>(sums.block[e][0]) * width;
+      double* R_k = partial.data() + static_cast<size_t>(sums.block[e][1]) * width;
+      double* R_jk = partial.data() + static_cast<size_t>(sums.block[e][2]) * width;
+
+      for (int b = 0; b < width; b += LANES)
+      {
+        double flux[LANES];
+        for (int m = 0; m < LANES; ++m) flux[m] = static_cast<double>(rate_e[b + m]) * C_j[b + m] * C_k[b + m];
+
+        for (int m = 0; m < LANES; ++m) R_j[b + m] -= flux[m];
+        for (int m = 0; m < LANES; ++m) R_k[b + m] -= flux[m];
+        for (int m = 0; m < LANES; ++m) R_jk[b + m] += flux[m];
+      }
+    }
+  }
+
+  // The blocks of each size added in order, R[0] has none as annihilations have no product
+  for (int i = -state_size; i <= state_size; ++i)
+  {
+    const int first = sums.block_start[i + state_size], last = sums.block_start[i + state_size + 1];
+    double* R_i = R + Row(i);
+    if (first == last) std::fill_n(R_i, width, 0.0);
+    else std::copy_n(partial.data() + static_cast<size_t>(first) * width, width, R_i);
+
+    for (int b = first + 1; b < last; ++b)
+    {
+      const double* partial_b = partial.data() + static_cast<size_t>(b) * width;
+      for (int m = 0; m < width; ++m) R_i[m] += partial_b[m];
+    }
+  }
+}
+
+template <typename Policy>
+void BasicEnsemble<Policy>::GetDerivatives(const Storage* C, double* dCdt) const
+{
+  MMD_TRACE_SCOPE("ensemble rates");
+  GetReactionRates(C, dCdt);
+
+  for (int i = -state_size; i <= state_size; ++i)
+  {
+    if (i == 0) continue;
+
+    const Storage* g = generation.data() + Row(i);
+    const Storage* s = sink.data() + Row(i);
+    const Storage* C_i = C + Row(i);
+    double* dC_i = dCdt + Row(i);
+    for (int m = 0; m < width; ++m) dC_i[m] += static_cast<double>(g[m]) - static_cast<double>(s[m]) * C_i[m];
+  }
+}
+
+template <typename Policy>
+void BasicEnsemble<Policy>::Step(double dt)
+{
+  MMD_TRACE_SCOPE("ensemble update");
+  GetDerivatives(C.data(), dCdt.data());
+
+  if constexpr (Policy::COMPENSATED)
+  {
+    for (size_t n = 0; n < C.size(); ++n) Accumulate<Policy>(C[n], compensation[n], dt * dCdt[n]);
+    std::fill_n(compensation.begin() + Row(0), width, 0.0);
+  }
+  else for (size_t n = 0; n < C.size(); ++n) C[n] += dt * dCdt[n];
+  std::fill_n(C.begin() + Row(0), width, 0.0);
+
+  MMD_TRACE_COUNT("ensemble steps", 1);
+  MMD_TRACE_CHECK_FINITE("CD_Kohnert ensemble step, species * width + member", C.data(), C.size(), 0);
+}
+
+template class BasicEnsemble<DoublePrecision>;
+template class BasicEnsemble<CompensatedPrecision>;
+template class BasicEnsemble<SinglePrecision>;
\ No newline at end of file
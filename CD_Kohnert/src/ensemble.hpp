@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+
+#include "cd.hpp"
+#include "../../common/aligned_allocator.hpp"
+#include "../../common/precision.hpp"
+
+// Many independent CDStates of the same size stepped together, as in a parameter sweep.
+//
+// Every per species array holds all the members side by side, species-major and member-minor, so
+// the value of species i in member m is at [(i + state_size) * width + m]. Each operation of the
+// reaction and derivative loops then runs over a contiguous row of members, LANES at a time, and
+// the reaction list is walked once per step for all of them rather than once per member.
+//
+// Members may differ in anything that only changes rates (temperature, C_s, dose rate) but must
+// share max_size, so their reaction lists match. Size groups aren't supported. Steps are forward
+// Euler with one dt for every member.
+//
+// Policy (common/precision.hpp) sets how the rates, generation, sinks and concentrations are
+// stored and how each step adds to the concentrations. Under DoublePrecision each member's
+// concentrations come out bit-identical to stepping its CDState on its own with ForwardEuler.
+// SinglePrecision halves the memory the reaction loop streams through, at the cost of converting
+// every value it reads, so it only pays off once the ensemble no longer fits in cache (see
+// bench/precision). Its compensated updates keep small increments from being lost.
+template <typename Policy>
+class BasicEnsemble
+{
+public:
+  static constexpr int LANES = 8; // Members per block, width is padded to a multiple of it
+
+  // The members must be initialized. Their rates and concentrations are copied in.
+  explicit BasicEnsemble(const std::vector<const CDState*>& members);
+
+  using Storage = typename Policy::Storage;
+
+  const int state_size;
+
+  int Size() const { return num_members; }
+
+  void Step(double dt);
+
+  // Right hand side of the rate equations for every member. C and dCdt are laid out as the
+  // ensemble stores its concentrations, (2 * state_size + 1) * width values.
+  void GetDerivatives(const Storage* C, double* dCdt) const;
+  void GetReactionRates(const Storage* C, double* R) const;
+
+  // Re-reads member m's rates, after its temperature, C_s or dose rate changed
+  void UpdateRates(int m, const CDState& member);
+
+  void GetConcentrations(int m, CDState::Concentrations& C) const;
+  void SetConcentrations(int m, const CDState::Concentrations& C);
+
+private:
+  int num_members;
+  int width; // num_members rounded up to LANES, the padding members have all rates zero
+
+  // Shared by every member, from the first member's reaction list
+  std::vector<int> row_start;
+  std::vector<int> partner;
+  CDState::ReactionSums sums; // The blocks each flux is added to, see CDState::ReactionSums
+
+  AlignedVector<Storage> rate; // Per reaction and member
+  AlignedVector<Storage> generation; // Per species and member
+  AlignedVector<Storage> sink; // K * C_s per species and member
+  AlignedVector<Storage> C;
+  AlignedVector<Storage> compensation; // Of C, when Policy::COMPENSATED
+  AlignedVector<double> dCdt; // Step work array
+  mutable AlignedVector<double> partial; // Sum of each block of CDState::ReactionSums, per member
+
+  size_t Row(int i) const { return static_cast<size_t>(i + state_size) * width; }
+};
+
+using Ensemble = BasicEnsemble<DoublePrecision>;
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "groups.hpp"
+
+SizeGroups::SizeGroups(int max_size)
+  : threshold(max_size)
+{
+}
+
+SizeGroups::SizeGroups(int threshold, int max_size, double growth)
+  : threshold(threshold)
+{
+  if (threshold < 1 || threshold >= max_size) throw std::invalid_argument("Group threshold must be between 1 and the largest size");
+  if (!(growth > 1.0)) throw std::invalid_argument("Group growth must be greater than 1");
+
+  for (int lo = threshold + 1; lo <= max_size;)
+  {
+    const int width = std::max(1, static_cast<int>(lo * (growth - 1)));
+    const int hi = std::min(max_size, lo + width - 1);
+
+    const double w = hi - lo + 1;
+    groups.push_back({lo, hi, 0.5 * (lo + hi), hi > lo ? 0.5 * (hi - lo) : 1.0, w * (w * w - 1) / 12});
+    lo = hi + 1;
+  }
+}
+
+int SizeGroups::GroupOf(int slot) const
+{
+  const int a = std::abs(slot);
+  if (a <= threshold) return -1;
+  return (a - threshold - 1) / 2;
+}
+
+void SizeGroups::Reconstruction(int g, int n, double& w0, double& w1) const
+{
+  const Group& group = groups[g];
+
+  // C_n = M0 / w + (n - mean) * scale * M1 / spread, matching both moments
+  w0 = 1.0 / (group.hi - group.lo + 1);
+  w1 = group.spread > 0.0 ? (n - group.mean) * group.scale / group.spread : 0.0;
+}
\ No newline at end of file
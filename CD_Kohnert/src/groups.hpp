@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+// Logarithmic size grouping for large clusters (Golubov, Ovcharenko et al. 2001).
+//
+// Sizes up to threshold stay discrete. Above it, sizes are lumped into groups whose width grows
+// geometrically, so the number of equations grows with log(max_size) rather than max_size. Each
+// group stores two moments over its sizes, M0 = sum C_n and M1 = sum Moment(n) C_n, and the
+// distribution inside a group is reconstructed as linear in n from them. Moment is centred and
+// scaled to [-1, 1] so that both are concentrations bounded by M0 and share the integrators'
+// tolerances; the group then holds mean M0 + scale M1 point defects.
+//
+// Groups are laid out after the discrete sizes on both sides of the concentration array, as
+// +-(threshold + 1 + 2 g) for M0 of group g and +-(threshold + 2 + 2 g) for its M1.
+class SizeGroups
+{
+public:
+  struct Group
+  {
+    int lo, hi; // Absolute sizes covered, inclusive
+    double mean; // (lo + hi) / 2
+    double scale; // Half the width, hi - mean, or 1 for a single size
+    double spread; // sum of (n - mean)^2 over the group
+
+    double Moment(int n) const { return (n - mean) / scale; } // Contribution of a size n cluster to M1
+  };
+
+  // No grouping, every size up to max_size is discrete
+  explicit SizeGroups(int max_size);
+
+  // Sizes above threshold are grouped, each group about (growth - 1) times as wide as its smallest size
+  SizeGroups(int threshold, int max_size, double growth);
+
+  const int threshold; // Largest discrete size
+  std::vector<Group> groups;
+
+  bool empty() const { return groups.empty(); }
+  int size() const { return groups.size(); }
+
+  // Half length of the concentration array, discrete sizes plus two moments per group
+  int StateSize() const { return threshold + 2 * size(); }
+
+  // Slots of the moments of group g, sign is +1 for interstitials and -1 for vacancies
+  int M0(int g, int sign) const { return sign * (threshold + 1 + 2 * g); }
+  int M1(int g, int sign) const { return sign * (threshold + 2 + 2 * g); }
+
+  // Group holding slot, or -1 for a discrete size
+  int GroupOf(int slot) const;
+
+  // Weights of the linear reconstruction, C_n = w0 M0 + w1 M1 for a size n in group g
+  void Reconstruction(int g, int n, double& w0, double& w1) const;
+};
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+
+#include <cmath>
+
+#include "integrator.hpp"
+#include "lazy_flux.hpp"
+#include "../../common/trace.hpp"
+
+// Sizes work arrays to the state they are used with, keeping their allocation between steps
+static void Fit(int state_size, std::initializer_list<CDState::Concentrations*> arrays)
+{
+  for (CDState::Concentrations* a : arrays) {
+    if (static_cast<int>(a->size()) != state_size) a->resize(state_size);
+  }
+}
+
+//-----------------------------------------------------------------
+// Forward Euler
+//-----------------------------------------------------------------
+
+template <typename Policy>
+double BasicForwardEuler<Policy>::Step(CDState& cd, double dt)
+{
+  if (static_cast<int>(dCdt.size()) != cd.state_size)
+  {
+    dCdt.resize(cd.state_size);
+    cd.Distribute(dCdt);
+  }
+  if (Policy::COMPENSATED && static_cast<int>(compensation.size()) != cd.state_size)
+  {
+    compensation.resize(cd.state_size);
+    cd.Distribute(compensation);
+  }
+
+  // In place, as every derivative is evaluated before any concentration changes. dCdt[0] is 0, so
+  // C[0] stays 0.
+  cd.GetDerivatives(cd.species.C, dCdt);
+  cd.ForEachBlock([&](int lo, int hi) {
+    if constexpr (Policy::COMPENSATED) {
+      for (int i = lo; i < hi; ++i) Accumulate<Policy>(cd.species.C[i], compensation[i], dt * dCdt[i]);
+    }
+    else for (int i = lo; i < hi; ++i) cd.species.C[i] += dt * dCdt[i];
+  });
+  return 0.0;
+}
+
+template <typename Policy>
+std::vector<double> BasicForwardEuler<Policy>::GetHistory() const
+{
+  if (!Policy::COMPENSATED || compensation.size() == 0) return {}; // Nothing carried before the first step
+  return std::vector<double>(compensation.data(), compensation.data() + 2 * compensation.size() + 1);
+}
+
+template <typename Policy>
+void BasicForwardEuler<Policy>::SetHistory(const double* history, size_t count)
+{
+  if (!Policy::COMPENSATED || count == 0) return;
+  compensation.resize((count - 1) / 2);
+  std::copy(history, history + count, compensation.data());
+}
+
+template class BasicForwardEuler<DoublePrecision>;
+template class BasicForwardEuler<CompensatedPrecision>;
+
+//-----------------------------------------------------------------
+// BDF
+//-----------------------------------------------------------------
+
+double BDF::Step(CDState& cd, double dt)
+{
+  Advance(cd, dt, 0);
+  return 0.0;
+}
+
+void BDF::Advance(CDState& cd, double dt, int halvings)
+{
+  if (TryStep(cd, dt)) return;
+
+  if (halvings == MAX_STEP_HALVINGS) throw std::runtime_error("BDF step failed to converge at dt = " + std::to_string(dt));
+  Advance(cd, dt / 2, halvings + 1);
+  Advance(cd, dt / 2, halvings + 1);
+}
+
+std::vector<double> BDF::GetHistory() const
+{
+  if (history_dt == 0.0) return {};
+
+  const int S = history.size();
+  std::vector<double> saved(history.data(), history.data() + 2 * S + 1);
+  saved.push_back(history_dt);
+  return saved;
+}
+
+void BDF::SetHistory(const double* saved, size_t count)
+{
+  history_dt = 0.0;
+  if (count == 0) return;
+
+  const int S = (count - 2) / 2;
+  history.resize(S);
+  std::copy(saved, saved + 2 * S + 1, history.data());
+  history_dt = saved[count - 1];
+}
+
+bool BDF::TryStep(CDState& cd, double dt)
+{
+  const int S = cd.state_size;
+  if (static_cast<int>(history.size()) != S) history_dt = 0.0; // No usable history for this state
+  Fit(S, {&history, &y_n, &base, &y, &f, &delta});
+
+  // y = a_n * y_n + a_prev * y_{n-1} + beta * dt * f(y)
+  double a_n = 1.0;
+  double a_prev = 0.0;
+  double beta = 1.0;
+  if (history_dt > 0.0)
+  {
+    const double w = dt / history_dt;
+    a_n = (1 + w) * (1 + w) / (1 + 2 * w);
+    a_prev = -w * w / (1 + 2 * w);
+    beta = (1 + w) / (1 + 2 * w);
+  }
+
+  if (!J.IsConfigured()) cd.InitJacobian(J);
+
+  cd.GetConcentrations(y_n);
+
+  for (int i = -S; i <= S; ++i) base[i] = a_n * y_n[i] + a_prev * history[i];
+
+  y.set(y_n);
+
+  const double newton_rtol = cd.GetLazyFlux() ? std::max(NEWTON_RTOL, cd.GetLazyFlux()->Rtol()) : NEWTON_RTOL;
+  bool converged = false;
+  double prev_norm = 0.0;
+  for (int iteration = 0; iteration < MAX_NEWTON_ITERATIONS; ++iteration)
+  {
+    MMD_TRACE_COUNT("newton iterations", 1);
+    cd.GetDerivatives(y, f);
+    cd.GetJacobian(y, J);
+    M.Factor(J, beta * dt);
+
+    for (int i = -S; i <= S; ++i) delta[i] = base[i] + beta * dt * f[i] - y[i];
+    M.Solve(delta.data());
+
+    double norm = 0.0;
+    for (int i = -S; i <= S; ++i)
+    {
+      y[i] += delta[i];
+      const double scaled = delta[i] / (NEWTON_ATOL + newton_rtol * std::abs(y[i]));
+      norm += scaled * scaled;
+    }
+    norm = std::sqrt(norm / (2 * S + 1));
+
+    if (!std::isfinite(norm)) break;
+    if (norm <= 1.0) { converged = true; break; }
+    if (iteration > 1 && norm > prev_norm) break; // Diverging
+
+    prev_norm = norm;
+  }
+
+  if (!converged)
+  {
+    MMD_TRACE_COUNT("newton failures", 1);
+    return false;
+  }
+
+  history.set(y_n);
+  history_dt = dt;
+  cd.SetConcentrations(y);
+  return true;
+}
+
+//-----------------------------------------------------------------
+// Rosenbrock
+//-----------------------------------------------------------------
+
+double Rosenbrock::Step(CDState& cd, double dt)
+{
+  const int S = cd.state_size;
+  Fit(S, {&y, &k1, &k2, &stage});
+
+  if (!J.IsConfigured()) cd.InitJacobian(J);
+
+  cd.GetConcentrations(y);
+  cd.GetJacobian(y, J);
+  M.Factor(J, gamma * dt);
+
+  // (I - gamma dt J) k1 = f(y)
+  cd.GetDerivatives(y, k1);
+  M.Solve(k1.data());
+
+  // (I - gamma dt J) k2 = f(y + dt k1) - 2 k1
+  for (int i = -S; i <= S; ++i) stage[i] = y[i] + dt * k1[i];
+  cd.GetDerivatives(stage, k2);
+  for (int i = -S; i <= S; ++i) k2[i] -= 2 * k1[i];
+  M.Solve(k2.data());
+
+  ErrorNorm error(tolerances);
+  for (int i = -S; i <= S; ++i)
+  {
+    const double y_old = y[i];
+    y[i] += dt * (1.5 * k1[i] + 0.5 * k2[i]);
+    error.Add(dt * 0.5 * (k1[i] + k2[i]), y_old, y[i]);
+  }
+
+  cd.SetConcentrations(y);
+  return error.Value();
+}
+
+//-----------------------------------------------------------------
+
+std::unique_ptr<Integrator> MakeIntegrator(const std::string& name, const std::string& precision)
+{
+  if (name == "euler" && precision == CompensatedPrecision::NAME) return std::make_unique<BasicForwardEuler<CompensatedPrecision>>();
+  if (precision != DoublePrecision::NAME) return nullptr;
+  if (name == "euler") return std::make_unique<ForwardEuler>();
+  if (name == "bdf") return std::make_unique<BDF>();
+  if (name == "rosenbrock") return std::make_unique<Rosenbrock>();
+  return nullptr;
+}
\ No newline at end of file
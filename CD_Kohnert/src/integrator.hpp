@@ -0,0 +1,121 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cd.hpp"
+#include "jacobian.hpp"
+#include "../../common/adaptive.hpp"
+#include "../../common/precision.hpp"
+
+// Advances a CDState by one time step. Implementations may keep history between calls.
+class Integrator
+{
+public:
+  virtual ~Integrator() = default;
+
+  // Returns the norm of the embedded error estimate relative to the tolerances (<= 1 is
+  // acceptable), or 0 for methods without one
+  virtual double Step(CDState& cd, double dt) = 0;
+  virtual const char* Name() const = 0;
+
+  // Order of the embedded error estimate, 0 if the method cannot drive adaptive stepping
+  virtual int ErrorOrder() const { return 0; }
+
+  void SetTolerances(const Tolerances& tol) { tolerances = tol; }
+
+  // State carried from one step to the next, saved with checkpoints. Empty for methods without any.
+  virtual std::vector<double> GetHistory() const { return {}; }
+  virtual void SetHistory(const double*, size_t) {}
+
+  // Whether count values from GetHistory, for a state of state_size, are something SetHistory takes
+  virtual bool ValidHistory(size_t count, int) const { return count == 0; }
+
+  // Drops any history, so the next step doesn't reach back across a jump in the rates
+  virtual void Restart() {}
+
+protected:
+  Tolerances tolerances;
+};
+
+// Explicit first order method. Only stable while dt is below the fastest reaction/sink time scale.
+// Policy (common/precision.hpp) sets how each step is added to the concentrations. CDState stores
+// doubles, so SinglePrecision is for ensembles only.
+template <typename Policy>
+class BasicForwardEuler : public Integrator
+{
+  static_assert(std::is_same_v<typename Policy::Storage, double>, "CDState stores its concentrations as double");
+
+public:
+  double Step(CDState& cd, double dt) override;
+  const char* Name() const override { return "euler"; }
+
+  // The rounding the compensated updates carry, so a restart continues the same sum
+  std::vector<double> GetHistory() const override;
+  void SetHistory(const double* history, size_t count) override;
+  bool ValidHistory(size_t count, int state_size) const override { return count == 0 || count == 2 * static_cast<size_t>(state_size) + 1; }
+
+private:
+  CDState::Concentrations dCdt;
+  CDState::Concentrations compensation; // Of the concentrations, when Policy::COMPENSATED
+};
+
+using ForwardEuler = BasicForwardEuler<DoublePrecision>;
+
+// Variable step BDF2 (BDF1 for the first step), solved by Newton iteration on the analytic Jacobian.
+// If Newton fails to converge the step is retried as two half steps, and one that still fails after
+// MAX_STEP_HALVINGS throws. With lazy fluxes (CDState::SetLazyFlux) Newton stops at their rtol,
+// as the residual is no more accurate than that.
+class BDF : public Integrator
+{
+public:
+  double Step(CDState& cd, double dt) override;
+  const char* Name() const override { return "bdf"; }
+
+  std::vector<double> GetHistory() const override; // The previous state, then its step length
+  void SetHistory(const double* history, size_t count) override;
+  bool ValidHistory(size_t count, int state_size) const override { return count == 0 || count == 2 * static_cast<size_t>(state_size) + 2; }
+  void Restart() override { history_dt = 0.0; } // Next step is BDF1
+
+private:
+  static constexpr int MAX_NEWTON_ITERATIONS = 12;
+  static constexpr int MAX_STEP_HALVINGS = 20;
+  static constexpr double NEWTON_RTOL = 1e-9;
+  static constexpr double NEWTON_ATOL = 1e-20;
+
+  void Advance(CDState& cd, double dt, int halvings);
+  bool TryStep(CDState& cd, double dt); // Leaves cd unchanged and returns false if it doesn't converge
+
+  Jacobian J;
+  NewtonMatrix M;
+
+  CDState::Concentrations history; // State at the start of the previous step
+  double history_dt = 0.0; // Length of the previous step, 0 before the first one
+
+  CDState::Concentrations y_n, base, y, f, delta;
+};
+
+// Two stage, second order, L-stable Rosenbrock method (ROS2, Verwer et al. 1999).
+// Linearly implicit: one Jacobian and one factorization per step, no iteration.
+// The embedded first order solution y + dt * k1 provides the error estimate.
+class Rosenbrock : public Integrator
+{
+public:
+  double Step(CDState& cd, double dt) override;
+  const char* Name() const override { return "rosenbrock"; }
+  int ErrorOrder() const override { return 1; }
+
+private:
+  static constexpr double gamma = 1.0 + 1.0 / 1.4142135623730951;
+
+  Jacobian J;
+  NewtonMatrix M;
+
+  CDState::Concentrations y, k1, k2, stage;
+};
+
+// Returns nullptr for unknown names, or a precision (see common/precision.hpp) the integrator
+// doesn't support. Only euler takes any but double, and not single.
+std::unique_ptr<Integrator> MakeIntegrator(const std::string& name, const std::string& precision = DoublePrecision::NAME);
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include <cmath>
+
+#include "jacobian.hpp"
+#include "../../common/trace.hpp"
+
+//-----------------------------------------------------------------
+// Jacobian
+//-----------------------------------------------------------------
+
+void Jacobian::Configure(int max_size, const std::vector<int>& border, int half_width)
+{
+  this->max_size = max_size;
+  this->half_width = half_width;
+  this->border = border;
+
+  position.assign(2 * max_size + 1, 0);
+  for (size_t b = 0; b < border.size(); ++b) position[border[b] + max_size] = 1; // Mark, assigned below
+
+  interior.clear();
+  for (int i = -max_size; i <= max_size; ++i) {
+    if (!position[i + max_size]) interior.push_back(i);
+  }
+
+  for (size_t b = 0; b < border.size(); ++b) position[border[b] + max_size] = b;
+  for (size_t r = 0; r < interior.size(); ++r) position[interior[r] + max_size] = -1 - static_cast<int>(r);
+
+  const size_t width = 2 * half_width + 1;
+  band.assign(interior.size() * width, 0.0);
+  border_cols.assign(interior.size() * border.size(), 0.0);
+  border_rows.assign(border.size() * interior.size(), 0.0);
+  corner.assign(border.size() * border.size(), 0.0);
+}
+
+void Jacobian::Clear()
+{
+  std::fill(band.begin(), band.end(), 0.0);
+  std::fill(border_cols.begin(), border_cols.end(), 0.0);
+  std::fill(border_rows.begin(), border_rows.end(), 0.0);
+  std::fill(corner.begin(), corner.end(), 0.0);
+}
+
+void Jacobian::Add(int row, int col, double value)
+{
+  const int r = position[row + max_size];
+  const int c = position[col + max_size];
+  const size_t num_border = border.size();
+  const size_t num_interior = interior.size();
+
+  if (r >= 0 && c >= 0) corner[r * num_border + c] += value;
+  else if (r >= 0) border_rows[r * num_interior + (-1 - c)] += value;
+  else if (c >= 0) border_cols[(-1 - r) * num_border + c] += value;
+  else
+  {
+    const int ri = -1 - r;
+    const int offset = (-1 - c) - ri;
+    if (offset < -half_width || offset > half_width) throw std::logic_error("Jacobian entry outside of the band");
+    band[ri * (2 * half_width + 1) + half_width + offset] += value;
+  }
+}
+
+//-----------------------------------------------------------------
+// NewtonMatrix
+//-----------------------------------------------------------------
+
+void NewtonMatrix::Factor(const Jacobian& J, double scale)
+{
+  MMD_TRACE_SCOPE("factor");
+  pattern = &J;
+
+  const int w = J.half_width;
+  const int width = 2 * w + 1;
+  const int n = J.interior.size();
+  const int m = J.border.size();
+
+  // A = I - scale * J, split into the interior band B, border columns E, border rows F and corner D
+  band_lu.resize(J.band.size());
+  for (int r = 0; r < n; ++r) {
+    for (int o = 0; o < width; ++o) band_lu[r * width + o] = (o == w ? 1.0 : 0.0) - scale * J.band[r * width + o];
+  }
+
+  band_solved_cols.resize(J.border_cols.size());
+  for (size_t e = 0; e < J.border_cols.size(); ++e) band_solved_cols[e] = -scale * J.border_cols[e];
+
+  border_rows.resize(J.border_rows.size());
+  for (size_t e = 0; e < J.border_rows.size(); ++e) border_rows[e] = -scale * J.border_rows[e];
+
+  schur_lu.resize(J.corner.size());
+  for (int a = 0; a < m; ++a) {
+    for (int b = 0; b < m; ++b) schur_lu[a * m + b] = (a == b ? 1.0 : 0.0) - scale * J.corner[a * m + b];
+  }
+
+  // Band LU in place, L below the diagonal with a unit diagonal
+  for (int k = 0; k < n; ++k)
+  {
+    const double pivot = band_lu[k * width + w];
+    for (int r = k + 1; r <= std::min(k + w, n - 1); ++r)
+    {
+      double& l = band_lu[r * width + w + (k - r)];
+      if (l == 0.0) continue;
+
+      l /= pivot;
+      for (int c = k + 1; c <= std::min(k + w, n - 1); ++c) {
+        band_lu[r * width + w + (c - r)] -= l * band_lu[k * width + w + (c - k)];
+      }
+    }
+  }
+
+  // Solves multiply by the reciprocal so the back substitution has no division in its dependency chain
+  inverse_diagonal.resize(n);
+  for (int k = 0; k < n; ++k) inverse_diagonal[k] = 1.0 / band_lu[k * width + w];
+
+  // X = B^-1 E, one band solve per border column
+  interior_work.resize(n);
+  border_work.resize(m);
+  for (int b = 0; b < m; ++b)
+  {
+    for (int r = 0; r < n; ++r) interior_work[r] = band_solved_cols[r * m + b];
+    BandSolve(interior_work.data());
+    for (int r = 0; r < n; ++r) band_solved_cols[r * m + b] = interior_work[r];
+  }
+
+  // S = D - F X, factored with partial pivoting
+  for (int a = 0; a < m; ++a) {
+    for (int r = 0; r < n; ++r)
+    {
+      const double f = border_rows[a * n + r];
+      if (f == 0.0) continue;
+      for (int b = 0; b < m; ++b) schur_lu[a * m + b] -= f * band_solved_cols[r * m + b];
+    }
+  }
+
+  schur_pivots.resize(m);
+  for (int c = 0; c < m; ++c)
+  {
+    int pivot = c;
+    for (int r = c + 1; r < m; ++r) {
+      if (std::abs(schur_lu[r * m + c]) > std::abs(schur_lu[pivot * m + c])) pivot = r;
+    }
+    schur_pivots[c] = pivot;
+
+    if (pivot != c) {
+      for (int j = 0; j < m; ++j) std::swap(schur_lu[c * m + j], schur_lu[pivot * m + j]);
+    }
+
+    for (int r = c + 1; r < m; ++r)
+    {
+      const double factor = schur_lu[r * m + c] / schur_lu[c * m + c];
+      schur_lu[r * m + c] = factor;
+      for (int j = c + 1; j < m; ++j) schur_lu[r * m + j] -= factor * schur_lu[c * m + j];
+    }
+  }
+}
+
+void NewtonMatrix::BandSolve(double* x) const
+{
+  const int w = pattern->half_width;
+  const int width = 2 * w + 1;
+  const int n = pattern->interior.size();
+
+  for (int r = 1; r < n; ++r) {
+    for (int c = std::max(0, r - w); c < r; ++c) x[r] -= band_lu[r * width + w + (c - r)] * x[c];
+  }
+
+  for (int r = n - 1; r >= 0; --r)
+  {
+    for (int c = r + 1; c <= std::min(r + w, n - 1); ++c) x[r] -= band_lu[r * width + w + (c - r)] * x[c];
+    x[r] *= inverse_diagonal[r];
+  }
+}
+
+void NewtonMatrix::Solve(double* x) const
+{
+  MMD_TRACE_SCOPE("solve");
+  const Jacobian& J = *pattern;
+  const int n = J.interior.size();
+  const int m = J.border.size();
+
+  for (int r = 0; r < n; ++r) interior_work[r] = x[J.interior[r] + J.max_size];
+  for (int b = 0; b < m; ++b) border_work[b] = x[J.border[b] + J.max_size];
+
+  // y = B^-1 x_interior, then S x_border = x_border - F y
+  BandSolve(interior_work.data());
+
+  for (int a = 0; a < m; ++a) {
+    for (int r = 0; r < n; ++r) border_work[a] -= border_rows[a * n + r] * interior_work[r];
+  }
+
+  for (int c = 0; c < m; ++c) {
+    if (schur_pivots[c] != c) std::swap(border_work[c], border_work[schur_pivots[c]]);
+  }
+  for (int r = 1; r < m; ++r) {
+    for (int c = 0; c < r; ++c) border_work[r] -= schur_lu[r * m + c] * border_work[c];
+  }
+  for (int r = m - 1; r >= 0; --r)
+  {
+    for (int c = r + 1; c < m; ++c) border_work[r] -= schur_lu[r * m + c] * border_work[c];
+    border_work[r] /= schur_lu[r * m + r];
+  }
+
+  // x_interior = y - X x_border
+  for (int r = 0; r < n; ++r) {
+    for (int b = 0; b < m; ++b) interior_work[r] -= band_solved_cols[r * m + b] * border_work[b];
+  }
+
+  for (int r = 0; r < n; ++r) x[J.interior[r] + J.max_size] = interior_work[r];
+  for (int b = 0; b < m; ++b) x[J.border[b] + J.max_size] = border_work[b];
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+// Jacobian of the cluster dynamics rate equations, indexed by signed cluster size.
+//
+// Every reaction involves at least one mobile (small) species, so the nonzeros are confined to
+// the rows and columns of those species (the border) plus a band around the diagonal no wider
+// than the largest mobile size. Only that pattern is stored.
+class Jacobian
+{
+public:
+  // border lists the sizes whose rows and columns are stored in full. Every other entry must lie
+  // within half_width of the diagonal.
+  void Configure(int max_size, const std::vector<int>& border, int half_width);
+  bool IsConfigured() const { return max_size >= 0; }
+
+  void Clear();
+  void Add(int row, int col, double value); // Throws std::logic_error outside of the pattern
+
+private:
+  friend class NewtonMatrix;
+
+  int max_size = -1;
+  int half_width = 0;
+
+  std::vector<int> border; // Sizes stored in full
+  std::vector<int> interior; // Every other size, in increasing order
+  std::vector<int> position; // By size + max_size: index into border if >= 0, else -1 - index into interior
+
+  std::vector<double> band; // interior x (2 * half_width + 1)
+  std::vector<double> border_cols; // interior x border
+  std::vector<double> border_rows; // border x interior
+  std::vector<double> corner; // border x border
+};
+
+// Factorization of (I - scale * J) for the Newton and stage solves of the implicit integrators.
+// The interior band is eliminated without pivoting (the matrix is diagonally dominant for any
+// scale > 0), and the small border is solved through its dense Schur complement, so both
+// factoring and solving are linear in the number of species.
+class NewtonMatrix
+{
+public:
+  void Factor(const Jacobian& J, double scale);
+  void Solve(double* x) const; // x is indexed by size + max_size, overwritten with the solution
+
+private:
+  const Jacobian* pattern = nullptr;
+
+  std::vector<double> band_lu;
+  std::vector<double> inverse_diagonal;
+  std::vector<double> border_rows; // border x interior, F
+  std::vector<double> band_solved_cols; // interior x border, X = B^-1 E
+  std::vector<double> schur_lu; // border x border, D - F X
+  std::vector<int> schur_pivots;
+
+  mutable std::vector<double> interior_work;
+  mutable std::vector<double> border_work;
+
+  void BandSolve(double* x) const;
+};
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "lazy_flux.hpp"
+#include "cd.hpp"
+#include "../../common/trace.hpp"
+
+void LazyFlux::Configure(const CDState& cd)
+{
+  state_size = cd.state_size;
+  const int S = state_size;
+  const CDState::ReactionList& reactions = cd.reactions;
+
+  rows.clear();
+  row.resize(reactions.partner.size());
+  partner_start.assign(2 * S + 2, 0);
+  for (int j = -S; j <= S; ++j)
+  {
+    const int first = reactions.row_start[j + S], last = reactions.row_start[j + S + 1];
+    if (first == last) continue;
+
+    for (int e = first; e < last; ++e)
+    {
+      row[e] = rows.size();
+      ++partner_start[reactions.partner[e] + S + 1];
+    }
+    rows.push_back(j);
+  }
+
+  std::partial_sum(partner_start.begin(), partner_start.end(), partner_start.begin());
+  by_partner.resize(reactions.partner.size());
+  std::vector<int> next(partner_start.begin(), partner_start.end() - 1);
+  for (size_t e = 0; e < reactions.partner.size(); ++e) by_partner[next[reactions.partner[e] + S]++] = e;
+
+  exposure.assign(rows.size(), SignedArray<double>(S));
+  seen.resize(S);
+  calls = refresh;
+}
+
+void LazyFlux::Rebuild(const CDState& cd, const SignedArray<double>& C)
+{
+  const int S = state_size;
+  const CDState::ReactionList& reactions = cd.reactions;
+
+  for (SignedArray<double>& x : exposure) x.fill(0.0);
+  seen.set(C);
+  for (size_t r = 0; r < rows.size(); ++r)
+  {
+    const int j = rows[r];
+    SignedArray<double>& x = exposure[r];
+    for (int e = reactions.row_start[j + S]; e < reactions.row_start[j + S + 1]; ++e)
+    {
+      const int k = reactions.partner[e];
+      const double term = reactions.rate[e] * C[k];
+      x[j] -= term;
+      x[k] -= term;
+      x[j + k] += term;
+    }
+  }
+
+  calls = 0;
+  ++rebuilds;
+  MMD_TRACE_COUNT("lazy flux rebuilds", 1);
+}
+
+void LazyFlux::ReactionRates(const CDState& cd, const SignedArray<double>& C, SignedArray<double>& R)
+{
+  if (state_size != cd.state_size) Configure(cd);
+  const int S = state_size;
+  const CDState::ReactionList& reactions = cd.reactions;
+  const long long count = reactions.partner.size();
+
+  long long reused = 0;
+  if (calls >= refresh) Rebuild(cd, C);
+  else
+  {
+    for (int k = -S; k <= S; ++k)
+    {
+      const int first = partner_start[k + S], last = partner_start[k + S + 1];
+      if (first == last) continue;
+
+      // NaN never counts as unchanged, so it still reaches R
+      const double change = C[k] - seen[k];
+      if (std::abs(change) <= rtol * std::max(std::abs(C[k]), std::abs(seen[k])))
+      {
+        reused += last - first;
+        continue;
+      }
+
+      seen[k] = C[k];
+      for (int n = first; n < last; ++n)
+      {
+        const int e = by_partner[n];
+        const int j = rows[row[e]];
+        SignedArray<double>& x = exposure[row[e]];
+        const double term = reactions.rate[e] * change;
+        x[j] -= term;
+        x[k] -= term;
+        x[j + k] += term;
+      }
+    }
+  }
+  ++calls;
+  terms += count;
+  skipped += reused;
+  MMD_TRACE_COUNT("lazy flux terms", count);
+  MMD_TRACE_COUNT("lazy flux terms skipped", reused);
+
+  // Each row's exposure weighted by its own, always current, concentration
+  R.fill(0.0);
+  for (size_t r = 0; r < rows.size(); ++r)
+  {
+    const double C_j = C[rows[r]];
+    const SignedArray<double>& x = exposure[r];
+    for (int i = -S; i <= S; ++i) R[i] += C_j * x[i];
+  }
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "signedarray.hpp"
+
+class CDState;
+
+// The reaction list's part of CDState::GetReactionRates, kept up to date between calls rather than
+// recomputed. Every reaction j + k has a mobile j, so its flux is C[j] times rate * C[k], and the
+// net rate of size i is the sum over the rows j of C[j] times the row's exposure at i, the sum of
+// rate * C[k] over the reactions of row j that i takes part in. The exposures only change with the
+// partners, which mostly sit still while the point defects move every step. A call revisits the
+// terms of the partners whose concentration has moved by more than rtol since the exposures last
+// saw it, adding the change, and skips the rest. Every refresh calls, and whenever the rates
+// change, the exposures are rebuilt from scratch so rounding in the updates can't build up.
+//
+// Fluxes are only accurate to rtol of each partner's concentration, so this is off unless asked
+// for, see CDState::SetLazyFlux. Serial, and only for the reaction list; size group fluxes are
+// still computed in full.
+class LazyFlux
+{
+public:
+  static constexpr int DEFAULT_REFRESH = 100; // Calls between rebuilds
+
+  explicit LazyFlux(double rtol, int refresh = DEFAULT_REFRESH) : rtol(rtol), refresh(refresh) {}
+
+  void Invalidate() { calls = refresh; } // The rates changed, rebuild on the next call
+
+  // Sets R to the net rate of every size from the reaction list at C, leaving R[0] for the caller
+  void ReactionRates(const CDState& cd, const SignedArray<double>& C, SignedArray<double>& R);
+
+  // Flux terms, one per reaction per call, and how many of them were reused, since construction
+  long long Terms() const { return terms; }
+  long long Skipped() const { return skipped; }
+  double Rtol() const { return rtol; } // Relative accuracy of the fluxes
+  double SkippedFraction() const { return terms > 0 ? static_cast<double>(skipped) / terms : 0.0; }
+  long Rebuilds() const { return rebuilds; }
+
+private:
+  void Configure(const CDState& cd);
+  void Rebuild(const CDState& cd, const SignedArray<double>& C);
+
+  const double rtol;
+  const int refresh;
+
+  int state_size = -1; // Of the state configured for
+  std::vector<int> rows; // Sizes with reactions, the mobile ones
+  std::vector<int> row; // Index in rows of each reaction's j
+  std::vector<int> partner_start, by_partner; // Reactions by partner k, CSR indexed by k + state_size
+  std::vector<SignedArray<double>> exposure; // Per row
+  SignedArray<double> seen; // Concentration each partner's terms were last computed at
+
+  int calls = 0; // Since the last rebuild
+  long long terms = 0, skipped = 0;
+  long rebuilds = 0;
+};
\ No newline at end of file
@@ -1,46 +1,433 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
 
 #include "cd.hpp"
+#include "checkpoint.hpp"
+#include "lazy_flux.hpp"
+#include "run.hpp"
+#include "ssa.hpp"
+#include "steady.hpp"
+#include "../../common/columns.hpp"
+#include "../../common/trace.hpp"
 
-void runCD(double dt, double total_time)
+struct CheckpointOptions
 {
-  CDState cd;
+  std::string file; // No checkpoints if empty
+  double interval = 60.0; // Wall clock seconds between checkpoints
+  std::string restart; // Checkpoint to continue from, if not empty
+};
 
-  cd.Init();
-  //cd.PrintReactionRates();
+struct TrajectoryOptions
+{
+  std::string file; // No trajectory if empty. CSV, or binary columns for .bin and .cbin (see common/columns.hpp)
+  int per_decade = 10; // Samples per factor of 10 in t, every step if 0
+  double first = 0.0; // First sample time after the start, dt if 0
+};
 
-  std::cout << "t";
-  for (int i = -cd.MAX_SIZE; i <= cd.MAX_SIZE; ++i)
+// Sample times evenly spaced in log t, per_decade for every factor of 10 from first on, or every
+// step if per_decade is 0. The first step to reach a sample time is sampled, so sampling never
+// changes the steps taken.
+class LogSampler
+{
+public:
+  LogSampler(double first, int per_decade) : first(first), per_decade(per_decade), next(first) {}
+
+  // Whether the step that ended at t is sampled, moving on to the first sample time after t
+  bool Due(double t)
   {
-    if (i == 0) continue;
-    std::cout << ", C_" << i; 
+    if (per_decade == 0) return true;
+    if (t < next) return false;
+    while (next <= t) next = first * std::pow(10.0, static_cast<double>(++index) / per_decade);
+    return true;
   }
-  std::cout << "\n";
 
-  for (double t = 0; t < total_time; t += dt)
+private:
+  const double first;
+  const int per_decade;
+  long index = 0;
+  double next;
+};
+
+void runCD(RunOptions options, const CheckpointOptions& checkpoints, const TrajectoryOptions& trajectory, double restart_total_time)
+{
+  RunProgress progress;
+  progress.dt = options.dt;
+
+  std::unique_ptr<CDState> state;
+  if (checkpoints.restart.empty()) state = MakeState(options);
+  else
   {
+    state = Checkpoint::Restore(checkpoints.restart, options, progress);
+    if (restart_total_time > 0) options.total_time = restart_total_time;
+    std::cerr << "Restarting at t = " << progress.t << " after " << progress.steps << " steps" << std::endl;
+  }
+  CDState& cd = *state;
+  //cd.PrintReactionRates();
+
+  std::cout << "t";
+  ForEachOutputColumn(cd, [](const std::string& size, double) { std::cout << ", C_" << size; });
+  std::cout << "\n";
 
-    cd.Step(dt);
+  // Trajectory rows are copied out on this thread, then formatted, compressed and written on
+  // another, see AsyncColumnWriter
+  std::unique_ptr<ColumnWriter> samples;
+  LogSampler sampler(trajectory.first > 0 ? trajectory.first : options.dt, trajectory.per_decade);
+  std::vector<double> row;
+  double last_sample = -1.0;
+  auto sample = [&](double t) {
+    MMD_TRACE_SCOPE("output");
+    row.assign(1, t);
+    ForEachOutputColumn(cd, [&](const std::string&, double C) { row.push_back(C); });
+    samples->Write(row.data());
+    last_sample = t;
+  };
+  if (!trajectory.file.empty())
+  {
+    std::vector<std::string> names = {"t"};
+    ForEachOutputColumn(cd, [&](const std::string& size, double) { names.push_back("C_" + size); });
+    samples = std::make_unique<AsyncColumnWriter>(OpenColumnWriter(trajectory.file, names));
+    sampler.Due(progress.t);
+    sample(progress.t);
   }
-    std::cout << total_time;
-    for (int i = -cd.MAX_SIZE; i <= cd.MAX_SIZE; ++i) {
-      if (i == 0) continue;
-      std::cout << ", " << std::log(cd.species[i].C + 1);
+
+  // Checkpoint snapshots are likewise taken between steps and written in the background
+  using Clock = std::chrono::steady_clock;
+  const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(checkpoints.interval));
+  auto next_checkpoint = Clock::now() + interval;
+  std::unique_ptr<CheckpointWriter> checkpoint_writer;
+  if (!checkpoints.file.empty()) checkpoint_writer = std::make_unique<CheckpointWriter>(checkpoints.file);
+
+  std::function<void(const RunProgress&)> after_step;
+  if (samples || checkpoint_writer) after_step = [&](const RunProgress& p) {
+    if (samples && sampler.Due(p.t)) sample(p.t);
+    if (checkpoint_writer && Clock::now() >= next_checkpoint)
+    {
+      checkpoint_writer->Submit(Checkpoint::Capture(cd, options, p));
+      next_checkpoint = Clock::now() + interval;
     }
+  };
+  Integrate(cd, options, progress, after_step);
+
+  if (checkpoint_writer) checkpoint_writer->Submit(Checkpoint::Capture(cd, options, progress));
+  if (samples && last_sample != progress.t) sample(progress.t);
+  samples.reset(); // Waits for the writer to finish
+  std::cerr << progress.steps << " steps" << std::endl;
+  if (const LazyFlux* lazy = cd.GetLazyFlux()) {
+    std::cerr << "Lazy flux reused " << 100.0 * lazy->SkippedFraction() << "% of " << lazy->Terms() << " flux terms, with " << lazy->Rebuilds() << " full rebuilds" << std::endl;
+  }
+
+  {
+    MMD_TRACE_SCOPE("output");
+    std::cout << options.total_time;
+    ForEachOutputColumn(cd, [](const std::string&, double C) { std::cout << ", " << std::log(C + 1); });
     std::cout << "\n";
+  }
 }
 
+// Prints the steady state as a single row at t = inf
+int steadyCD(const RunOptions& options)
+{
+  std::unique_ptr<CDState> state = MakeState(options);
+  CDState& cd = *state;
+
+  std::cout << "t";
+  ForEachOutputColumn(cd, [](const std::string& size, double) { std::cout << ", C_" << size; });
+  std::cout << "\n";
+
+  const SteadyStateResult result = SteadyStateSolver(options.tolerances).Solve(cd, options.dt);
+  if (!result.converged)
+  {
+    std::cerr << "No steady state after " << result.iterations << " iterations, residual " << result.residual << ", C_" << result.slowest << " still changing" << std::endl;
+    return 1;
+  }
+  std::cerr << "Steady state after " << result.iterations << " iterations" << std::endl;
+
+  MMD_TRACE_SCOPE("output");
+  std::cout << "inf";
+  ForEachOutputColumn(cd, [](const std::string&, double C) { std::cout << ", " << std::log(C + 1); });
+  std::cout << "\n";
+  return 0;
+}
+
+// Prints the mean of independent stochastic runs at total_time, see StochasticCD
+void stochasticCD(const RunOptions& options, const ReplicaOptions& replicas)
+{
+  std::unique_ptr<CDState> state = MakeState(options);
+  CDState& cd = *state;
+
+  std::cout << "t";
+  ForEachOutputColumn(cd, [](const std::string& size, double) { std::cout << ", C_" << size; });
+  std::cout << "\n";
+
+  CDState::Concentrations mean;
+  const long events = RunReplicas(cd, replicas, options.total_time, mean);
+  cd.SetConcentrations(mean);
+  std::cerr << events << " events in " << replicas.replicas << (replicas.replicas == 1 ? " replica" : " replicas") << std::endl;
+
+  MMD_TRACE_SCOPE("output");
+  std::cout << options.total_time;
+  ForEachOutputColumn(cd, [](const std::string&, double C) { std::cout << ", " << std::log(C + 1); });
+  std::cout << "\n";
+}
+
+int run(int argc, char** argv);
+
 int main(int argc, char** argv)
 {
-  if (argc < 3) 
+  // --trace file, for builds with TRACE=1 (see common/trace.hpp)
+  std::string trace_file;
+  std::vector<char*> args = {argv[0]};
+  for (int a = 1; a < argc; ++a)
+  {
+    if (std::strcmp(argv[a], "--trace") == 0 && a + 1 < argc) trace_file = argv[++a];
+    else args.push_back(argv[a]);
+  }
+  if (!trace_file.empty() && !TRACE_ENABLED) std::cerr << "Built without TRACE=1, --trace is ignored" << std::endl;
+
+  const int status = run(args.size(), args.data());
+  MMD_TRACE_FINISH(trace_file);
+  return status;
+}
+
+int run(int argc, char** argv)
+{
+  RunOptions options;
+  CheckpointOptions checkpoints;
+  TrajectoryOptions trajectory;
+  ReplicaOptions replicas;
+  int threads = 0;
+  std::string schedule_file;
+  bool integrator_given = false;
+
+  std::vector<char*> args;
+  for (int a = 1; a < argc; ++a)
   {
-    std::cout << "Too few args. Usage: test [dt] [steps]" << std::endl;
+    const bool has_value = a + 1 < argc;
+    if (std::strcmp(argv[a], "--sweep") == 0 && has_value)
+    {
+      return RunSweep(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--checkpoint") == 0 && has_value)
+    {
+      checkpoints.file = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--checkpoint-interval") == 0 && has_value)
+    {
+      checkpoints.interval = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--restart") == 0 && has_value)
+    {
+      checkpoints.restart = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--trajectory") == 0 && has_value)
+    {
+      trajectory.file = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--samples-per-decade") == 0 && has_value)
+    {
+      trajectory.per_decade = atoi(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--first-sample") == 0 && has_value)
+    {
+      trajectory.first = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--schedule") == 0 && has_value)
+    {
+      schedule_file = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--integrator") == 0 && has_value)
+    {
+      options.integrator = argv[++a];
+      integrator_given = true;
+    }
+    else if (std::strcmp(argv[a], "--max-size") == 0 && has_value)
+    {
+      options.max_size = atoi(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--group-threshold") == 0 && has_value)
+    {
+      options.group_threshold = atoi(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--group-growth") == 0 && has_value)
+    {
+      options.group_growth = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--adaptive") == 0)
+    {
+      options.adaptive = true;
+    }
+    else if (std::strcmp(argv[a], "--steady-state") == 0)
+    {
+      options.steady_state = true;
+    }
+    else if (std::strcmp(argv[a], "--ssa") == 0 && has_value)
+    {
+      replicas.volume = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--replicas") == 0 && has_value)
+    {
+      replicas.replicas = atoi(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--seed") == 0 && has_value)
+    {
+      replicas.seed = std::strtoull(argv[++a], nullptr, 10);
+    }
+    else if (std::strcmp(argv[a], "--threads") == 0 && has_value)
+    {
+      threads = atoi(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--lazy-flux") == 0 && has_value)
+    {
+      options.lazy_flux = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--precision") == 0 && has_value)
+    {
+      options.precision = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--material") == 0 && has_value)
+    {
+      try {
+        options.material = *Material::Get(argv[++a]);
+      }
+      catch (const std::exception& e) {
+        std::cout << "Bad material: " << e.what() << std::endl;
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[a], "--rtol") == 0 && has_value)
+    {
+      options.tolerances.rtol = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--atol") == 0 && has_value)
+    {
+      options.tolerances.atol = atof(argv[++a]);
+    }
+    else
+    {
+      args.push_back(argv[a]);
+    }
+  }
+
+  // Threads split each step of a run, or share out the replicas of a stochastic one
+  if (threads < 0)
+  {
+    std::cout << "--threads must be at least 1" << std::endl;
+    return 1;
+  }
+  if (threads > 0) options.threads = threads;
+  replicas.threads = threads;
+
+  if (options.precision == SinglePrecision::NAME)
+  {
+    std::cout << "Single precision stores an ensemble's state, use it through --sweep" << std::endl;
+    return 1;
+  }
+
+  if (!schedule_file.empty())
+  {
+    try {
+      options.schedule = std::make_shared<const Schedule>(Schedule::Load(schedule_file, ScheduleDefaults(options)));
+    }
+    catch (const std::exception& e) {
+      std::cout << "Bad schedule " << schedule_file << ": " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  if (trajectory.per_decade < 0)
+  {
+    std::cout << "--samples-per-decade must not be negative" << std::endl;
+    return 1;
+  }
+
+  // A restart takes every setting from the checkpoint, except optionally a new total_time and the
+  // schedule, which has to be given again
+  if (!checkpoints.restart.empty())
+  {
+    try {
+      runCD(options, checkpoints, trajectory, args.empty() ? 0.0 : atof(args[0]));
+    }
+    catch (const std::exception& e) {
+      std::cout << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (options.steady_state)
+  {
+    // Only the first pseudo time step, dt, is needed
+    if (!args.empty()) options.dt = atof(args[0]);
+    const std::string problem = CheckOptions(options);
+    if (!problem.empty())
+    {
+      std::cout << problem << std::endl;
+      return 1;
+    }
+    return steadyCD(options);
+  }
+
+  if (replicas.volume != 0.0)
+  {
+    // Event driven, so there is no dt, only how long to run
+    if (!args.empty()) options.total_time = atof(args.back());
+    std::string problem = CheckOptions(options);
+    if (problem.empty() && !(replicas.volume > 0.0)) problem = "--ssa needs a positive volume";
+    if (problem.empty() && replicas.replicas < 1) problem = "--replicas must be at least 1";
+    if (problem.empty() && (options.group_threshold > 0 || options.schedule || !checkpoints.file.empty() || !trajectory.file.empty() || options.lazy_flux > 0.0 || options.precision != DoublePrecision::NAME)) {
+      problem = "--ssa doesn't support --group-threshold, --schedule, --checkpoint, --trajectory, --lazy-flux or --precision";
+    }
+    if (problem.empty() && !(options.total_time > 0.0)) problem = "--ssa needs a total_time";
+    if (!problem.empty())
+    {
+      std::cout << problem << std::endl;
+      return 1;
+    }
+
+    try {
+      stochasticCD(options, replicas);
+    }
+    catch (const std::exception& e) {
+      std::cout << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (args.size() < 2) 
+  {
+    std::cout << "Too few args. Usage: cd [--sweep config.json] [--integrator euler|bdf|rosenbrock] [--max-size n] [--group-threshold n] [--group-growth r] [--material name|file] [--adaptive] [--rtol r] [--atol a] [--threads n] [--lazy-flux r] [--precision double|compensated] [--checkpoint file] [--checkpoint-interval seconds] [--trajectory file [--samples-per-decade n] [--first-sample t]] [--schedule file] [--trace file] [dt] [total_time]" << std::endl;
+    std::cout << "       cd --steady-state [--max-size n] [--material name|file] [--rtol r] [--atol a] [--lazy-flux r] [dt]" << std::endl;
+    std::cout << "       cd --ssa volume [--replicas n] [--seed s] [--threads n] [--max-size n] [--material name|file] total_time" << std::endl;
+    std::cout << "       cd --restart file [--threads n] [--lazy-flux r] [--precision double|compensated] [--checkpoint file] [--checkpoint-interval seconds] [--trajectory file ...] [--schedule file] [total_time]" << std::endl;
     return 1;
   }
 
-  double dt = atof(argv[1]);
-  double total_time = atof(argv[2]);
+  if (options.adaptive && !integrator_given) options.integrator = "rosenbrock";
 
-  runCD(dt, total_time);
+  const std::string problem = CheckOptions(options);
+  if (!problem.empty())
+  {
+    std::cout << problem << std::endl;
+    return 1;
+  }
+
+  options.dt = atof(args[0]);
+  options.total_time = atof(args[1]);
+
+  try {
+    runCD(options, checkpoints, trajectory, 0.0);
+  }
+  catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,361 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "run.hpp"
+#include "ensemble.hpp"
+#include "integrator.hpp"
+#include "steady.hpp"
+#include "../../common/sweep.hpp"
+#include "../../common/thread_pool.hpp"
+
+// Whether a case can be stepped as an Ensemble member, see BatchCases
+static bool Batchable(const RunOptions& options)
+{
+  return options.integrator == "euler" && !options.adaptive && options.group_threshold == 0 && !options.schedule && !options.steady_state && options.lazy_flux == 0.0;
+}
+
+std::string CheckOptions(const RunOptions& options)
+{
+  std::unique_ptr<Integrator> integrator = MakeIntegrator(options.integrator);
+  if (!integrator) return "Unknown integrator " + options.integrator + ". Options: euler, bdf, rosenbrock";
+  if (options.adaptive && integrator->ErrorOrder() == 0) {
+    return "Integrator " + options.integrator + " has no error estimate, use --integrator rosenbrock with --adaptive";
+  }
+
+  if (options.max_size < 1) return "--max-size must be at least 1";
+  if (options.threads < 1) return "--threads must be at least 1";
+  if (options.lazy_flux < 0.0) return "--lazy-flux must not be negative";
+  if (!WithPrecision(options.precision, [](auto) {})) return "Unknown precision " + options.precision + ". Options: double, compensated, single";
+  if (options.precision == SinglePrecision::NAME && !Batchable(options)) {
+    return "Single precision is for ensembles of fixed step euler cases without groups, schedules or --lazy-flux";
+  }
+  if (options.precision == CompensatedPrecision::NAME && (options.integrator != "euler" || options.steady_state)) return "Compensated precision is for the euler integrator";
+  if (options.lazy_flux > 0.0 && options.threads > 1) return "--lazy-flux runs serially, it doesn't combine with --threads";
+  if (const char* missing = options.material.Missing(CDState::MATERIAL_FIELDS)) return std::string("The material has no ") + missing;
+  if (options.group_threshold < 0 || options.group_threshold >= options.max_size || (options.group_threshold > 0 && !(options.group_growth > 1.0))) {
+    return "--group-threshold must be below --max-size, and --group-growth greater than 1";
+  }
+  return "";
+}
+
+std::unique_ptr<CDState> MakeState(const RunOptions& options)
+{
+  std::unique_ptr<CDState> cd = options.group_threshold > 0
+    ? std::make_unique<CDState>(options.max_size, options.group_threshold, options.group_growth)
+    : std::make_unique<CDState>(options.max_size);
+
+  cd->T = options.temperature;
+  cd->C_s = options.C_s;
+  cd->material = options.material;
+  // The CDState of a single precision case only sets up its ensemble, see RunSweep
+  cd->SetIntegrator(MakeIntegrator(options.integrator, options.precision == SinglePrecision::NAME ? DoublePrecision::NAME : options.precision));
+  cd->SetTolerances(options.tolerances);
+  cd->SetThreads(options.threads);
+  cd->SetLazyFlux(options.lazy_flux);
+  cd->Init();
+  return cd;
+}
+
+std::map<std::string, double> ScheduleDefaults(const RunOptions& options)
+{
+  return {{"temperature_kelvin", options.temperature}, {"C_s", options.C_s}, {"dose_rate", 1.0}};
+}
+
+// Sets the conditions the schedule gives for time t
+static void ApplySchedule(CDState& cd, const Schedule& schedule, double t, std::vector<double>& values)
+{
+  schedule.Evaluate(t, values);
+  cd.SetTemperature(values[schedule.Find("temperature_kelvin")]);
+  cd.C_s = values[schedule.Find("C_s")];
+  cd.SetDoseRate(values[schedule.Find("dose_rate")]);
+}
+
+// Integrate for a run with a schedule. Steps end on every breakpoint, so the integrators never
+// step across a jump in the conditions, and are otherwise as long as options allow.
+static void IntegrateScheduled(CDState& cd, const RunOptions& options, RunProgress& progress, const std::function<void(const RunProgress&)>& after_step)
+{
+  const Schedule& schedule = *options.schedule;
+  const double total_time = options.total_time;
+  double& t = progress.t;
+
+  std::vector<double> values;
+  bool at_breakpoint = true; // Set the conditions before the first step too
+  while (t < total_time)
+  {
+    if (at_breakpoint || schedule.Ramping(t)) ApplySchedule(cd, schedule, t, values);
+
+    const double event = std::min(total_time, schedule.NextBreakpoint(t));
+    if (options.adaptive) t = cd.AdaptiveStep(t, event, progress.dt);
+    else
+    {
+      const double h = std::min(options.dt, event - t);
+      cd.Step(h);
+      t += h;
+    }
+
+    at_breakpoint = t >= event;
+    if (at_breakpoint)
+    {
+      t = event;
+      cd.GetIntegrator().Restart();
+    }
+
+    ++progress.steps;
+    if (after_step) after_step(progress);
+  }
+}
+
+long Integrate(CDState& cd, const RunOptions& options)
+{
+  RunProgress progress;
+  progress.dt = options.dt;
+  Integrate(cd, options, progress);
+  return progress.steps;
+}
+
+void Integrate(CDState& cd, const RunOptions& options, RunProgress& progress, const std::function<void(const RunProgress&)>& after_step)
+{
+  if (options.schedule)
+  {
+    IntegrateScheduled(cd, options, progress, after_step);
+    return;
+  }
+
+  const double total_time = options.total_time;
+  double& t = progress.t;
+  long& steps = progress.steps;
+  if (options.adaptive)
+  {
+    double& dt = progress.dt;
+    while (t < total_time)
+    {
+      t = cd.AdaptiveStep(t, total_time, dt);
+      ++steps;
+      if (after_step) after_step(progress);
+    }
+  }
+  else
+  {
+    // t is recomputed from the step count so rounding error does not accumulate, and the
+    // last step is shortened to land exactly on total_time
+    const double dt = options.dt;
+    while (t < total_time)
+    {
+      cd.Step(std::min(dt, total_time - t));
+      t = std::min(++steps * dt, total_time);
+      if (after_step) after_step(progress);
+    }
+  }
+}
+
+// Splits the batchable cases into ensembles of at most width members that share max_size, dt and
+// total_time, so they take the same steps. Every other case is left to run alone.
+static std::vector<std::vector<size_t>> BatchCases(const std::vector<RunOptions>& options, int width)
+{
+  std::vector<std::vector<size_t>> batches;
+  std::vector<size_t> open; // Index in batches of the batch still filling, per distinct setting
+  for (size_t n = 0; n < options.size(); ++n)
+  {
+    const RunOptions& o = options[n];
+    if (width <= 1 || !Batchable(o))
+    {
+      batches.push_back({n});
+      continue;
+    }
+
+    auto same = [&](size_t b) {
+      const RunOptions& first = options[batches[b].front()];
+      return first.max_size == o.max_size && first.dt == o.dt && first.total_time == o.total_time && first.precision == o.precision;
+    };
+    auto found = std::find_if(open.begin(), open.end(), same);
+    if (found == open.end() || static_cast<int>(batches[*found].size()) == width)
+    {
+      if (found != open.end()) open.erase(found);
+      open.push_back(batches.size());
+      batches.push_back({n});
+    }
+    else batches[*found].push_back(n);
+  }
+  return batches;
+}
+
+// Integrate for a batch of cases with the same fixed steps and precision, see Batchable
+template <typename Policy>
+static long IntegrateEnsemble(std::vector<std::unique_ptr<CDState>>& states, const RunOptions& options)
+{
+  std::vector<const CDState*> members;
+  for (const auto& cd : states) members.push_back(cd.get());
+  BasicEnsemble<Policy> ensemble(members);
+
+  const double total_time = options.total_time;
+  const double dt = options.dt;
+  long steps = 0;
+  for (double t = 0; t < total_time; t = std::min(++steps * dt, total_time))
+  {
+    ensemble.Step(std::min(dt, total_time - t));
+  }
+
+  CDState::Concentrations C;
+  for (size_t m = 0; m < states.size(); ++m)
+  {
+    ensemble.GetConcentrations(m, C);
+    states[m]->SetConcentrations(C);
+  }
+  return steps;
+}
+
+RunOptions ReadOptions(const nlohmann::json& config)
+{
+  RunOptions options;
+  options.steady_state = config.value("steady_state", false);
+  options.dt = config.at("dt");
+  options.total_time = options.steady_state ? config.value("total_time", 0.0) : config.at("total_time").get<double>();
+  options.max_size = config.value("max_size", options.max_size);
+  options.group_threshold = config.value("group_threshold", options.group_threshold);
+  options.group_growth = config.value("group_growth", options.group_growth);
+  options.adaptive = config.value("adaptive", options.adaptive);
+  options.integrator = config.value("integrator", options.adaptive ? "rosenbrock" : options.integrator);
+  options.tolerances.rtol = config.value("rtol", options.tolerances.rtol);
+  options.tolerances.atol = config.value("atol", options.tolerances.atol);
+  options.temperature = config.value("temperature_kelvin", options.temperature);
+  options.C_s = config.value("C_s", options.C_s);
+  options.lazy_flux = config.value("lazy_flux", options.lazy_flux);
+  options.precision = config.value("precision", options.precision);
+  if (config.contains("material")) options.material = *Material::Get(config["material"].get<std::string>());
+
+  if (config.contains("schedule"))
+  {
+    const nlohmann::json& schedule = config["schedule"];
+    options.schedule = std::make_shared<const Schedule>(schedule.is_string()
+      ? Schedule::Load(schedule.get<std::string>(), ScheduleDefaults(options))
+      : Schedule(schedule, ScheduleDefaults(options)));
+  }
+  return options;
+}
+
+int RunSweep(const std::string& config_file_name)
+{
+  std::ifstream config_file(config_file_name);
+  if (!config_file.good())
+  {
+    std::cerr << "Could not open " << config_file_name << std::endl;
+    return 1;
+  }
+  nlohmann::json config;
+  std::vector<nlohmann::json> cases;
+  std::vector<std::string> keys;
+  try {
+    config = nlohmann::json::parse(config_file);
+    cases = ExpandSweep(config);
+    keys = SweepKeys(config);
+  }
+  catch (const std::exception& e) {
+    std::cerr << config_file_name << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  // Check every case up front rather than failing part way through the sweep
+  std::vector<RunOptions> options;
+  for (size_t n = 0; n < cases.size(); ++n)
+  {
+    std::string problem;
+    try {
+      options.push_back(ReadOptions(cases[n]));
+      problem = CheckOptions(options.back());
+    }
+    catch (const std::exception& e) {
+      problem = e.what();
+    }
+    if (!problem.empty())
+    {
+      std::cerr << "Case " << n << ": " << problem << std::endl;
+      return 1;
+    }
+  }
+
+  const std::string output_name = config.value("sweep_output", "sweep.csv");
+  std::ofstream output(output_name);
+  if (!output.good())
+  {
+    std::cerr << "Could not open " << output_name << std::endl;
+    return 1;
+  }
+
+  // One row per case and size, since cases may track different sizes
+  output << "case";
+  for (const std::string& key : keys) output << "," << key;
+  output << ",steps,size,C\n";
+
+  std::mutex output_mutex;
+  auto report = [&](size_t n, const CDState& cd, long steps) {
+    std::string label = std::to_string(n);
+    for (const std::string& key : keys) label += "," + SweepValue(cases[n][key]);
+
+    std::ostringstream rows;
+    rows.precision(std::numeric_limits<double>::max_digits10);
+    ForEachOutputColumn(cd, [&](const std::string& size, double C) {
+      rows << label << "," << steps << "," << size << "," << C << "\n";
+    });
+
+    std::lock_guard<std::mutex> lock(output_mutex);
+    output << rows.str();
+    std::cerr << "Case " << n << ": " << steps << " steps" << std::endl;
+  };
+
+  auto run_batch = [&](const std::vector<size_t>& batch) {
+    // Single precision cases are always stepped as ensembles, of one if need be
+    if (batch.size() == 1 && options[batch[0]].precision != SinglePrecision::NAME)
+    {
+      const RunOptions& o = options[batch[0]];
+      std::unique_ptr<CDState> cd = MakeState(o);
+      if (!o.steady_state)
+      {
+        report(batch[0], *cd, Integrate(*cd, o));
+        return;
+      }
+
+      // Reported with the iteration count as its steps
+      const SteadyStateResult result = SteadyStateSolver(o.tolerances).Solve(*cd, o.dt);
+      if (!result.converged) std::cerr << "Case " << batch[0] << ": no steady state, C_" << result.slowest << " still changing" << std::endl;
+      report(batch[0], *cd, result.iterations);
+      return;
+    }
+
+    std::vector<std::unique_ptr<CDState>> states;
+    for (size_t n : batch) states.push_back(MakeState(options[n]));
+    long steps = 0;
+    WithPrecision(options[batch[0]].precision, [&](auto policy) { steps = IntegrateEnsemble<decltype(policy)>(states, options[batch[0]]); });
+    for (size_t m = 0; m < batch.size(); ++m) report(batch[m], *states[m], steps);
+  };
+
+  // "ensemble": width steps up to width fixed step euler cases of the same precision at once, see ensemble.hpp
+  ThreadPool pool(config.value("threads", std::thread::hardware_concurrency()));
+  for (const std::vector<size_t>& batch : BatchCases(options, config.value("ensemble", 0)))
+  {
+    pool.Submit([&, batch] {
+      try {
+        run_batch(batch);
+      }
+      catch (const std::exception& e) {
+        // Name the case, the pool only rethrows the first failure
+        throw std::runtime_error("Case " + std::to_string(batch[0]) + ": " + e.what());
+      }
+    });
+  }
+  try {
+    pool.Wait();
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  std::cerr << "Wrote " << cases.size() << " cases to " << output_name << std::endl;
+  return 0;
+}
\ No newline at end of file
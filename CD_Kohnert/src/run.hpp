@@ -0,0 +1,96 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "cd.hpp"
+#include "../../common/adaptive.hpp"
+#include "../../common/material.hpp"
+#include "../../common/precision.hpp"
+#include "../../common/schedule.hpp"
+#include "../../vendor/nlohmann/json.hpp"
+
+// Everything that describes one simulation, from the command line or from a sweep config
+struct RunOptions
+{
+  double dt = 0.0; // Fixed step, or the first step to try when adaptive
+  double total_time = 0.0;
+  int max_size = CDState::DEFAULT_MAX_SIZE;
+  int group_threshold = 0; // 0 keeps every size discrete
+  double group_growth = CDState::DEFAULT_GROUP_GROWTH;
+  std::string integrator = "euler";
+  bool adaptive = false;
+  Tolerances tolerances;
+
+  double temperature = CDState::DEFAULT_T;
+  double C_s = CDState::DEFAULT_C_S;
+  Material material = KOHNERT_EXAMPLE;
+
+  std::shared_ptr<const Schedule> schedule; // Conditions that change over the run, if any
+
+  unsigned threads = 1; // Threads each step is split over, see CDState::SetThreads. Not saved with checkpoints.
+  double lazy_flux = 0.0; // Reuse flux terms within this relative change, see CDState::SetLazyFlux. Not saved with checkpoints.
+
+  // Precision policy of the euler updates and of ensembles (common/precision.hpp): double,
+  // compensated, or single for sweep ensembles only. Not saved with checkpoints.
+  std::string precision = DoublePrecision::NAME;
+
+  bool steady_state = false; // Solve for the long time limit instead, with dt the first pseudo time step (see steady.hpp)
+};
+
+// The quantities a schedule can set, temperature_kelvin, C_s and dose_rate, with their values in options
+std::map<std::string, double> ScheduleDefaults(const RunOptions& options);
+
+// Calls column(label, concentration) for every size from the largest vacancy cluster to the largest
+// interstitial one. Grouped sizes are one column, labelled lo..hi, with the mean concentration per size.
+template <typename Column>
+void ForEachOutputColumn(const CDState& cd, Column&& column)
+{
+  for (int i = -cd.state_size; i <= cd.state_size; ++i)
+  {
+    if (i == 0) continue;
+
+    const int g = cd.groups.GroupOf(i);
+    const int sign = i > 0 ? 1 : -1;
+    if (g < 0) column(std::to_string(i), cd.species.C[i]);
+    else if (i == cd.groups.M0(g, sign))
+    {
+      const SizeGroups::Group& group = cd.groups.groups[g];
+      const std::string label = std::to_string(sign > 0 ? group.lo : -group.hi) + ".." + std::to_string(sign > 0 ? group.hi : -group.lo);
+      column(label, cd.species.C[i] / (group.hi - group.lo + 1));
+    }
+  }
+}
+
+// Returns what is wrong with options, or an empty string if they describe a valid run
+std::string CheckOptions(const RunOptions& options);
+
+// A state set up as options describe, ready to step
+std::unique_ptr<CDState> MakeState(const RunOptions& options);
+
+// How far a run has got, carried across checkpoints
+struct RunProgress
+{
+  double t = 0.0;
+  double dt = 0.0; // Step to try next when adaptive
+  long steps = 0;
+};
+
+// Runs cd from 0 to options.total_time, returning the number of steps taken
+long Integrate(CDState& cd, const RunOptions& options);
+
+// Runs cd from progress.t to options.total_time, keeping progress up to date. after_step, if set,
+// is called after every accepted step. With a schedule every breakpoint ends a step, where the new
+// conditions are set and the integrator restarted, and inside ramps they are updated every step.
+void Integrate(CDState& cd, const RunOptions& options, RunProgress& progress, const std::function<void(const RunProgress&)>& after_step = nullptr);
+
+// Options from a sweep case. Keys match the command line options with '_' for '-', plus
+// temperature_kelvin and C_s, and missing keys keep their defaults. schedule is a file name or
+// the list of breakpoints itself.
+RunOptions ReadOptions(const nlohmann::json& config);
+
+// Runs every case of a sweep config (see common/sweep.hpp) on a thread pool and writes the final
+// concentrations of all of them to one CSV file. Returns the process exit code.
+int RunSweep(const std::string& config_file_name);
\ No newline at end of file
@@ -1,32 +1,76 @@
 #pragma once
 
-#include <array>
+#include <algorithm>
 #include <stdlib.h>
 
-template<typename T, size_t S>
+#include "../../common/aligned_allocator.hpp"
+
+// Heap backed array indexed from -max_size to max_size, sized at runtime
+template<typename T>
 class SignedArray {
 private:
-  std::array<T, 2 * S + 1> elements;
+  FirstTouchVector<T> elements;
+  int max_size = 0;
 
 public:
   SignedArray() 
-    : elements{} 
+    : elements(1, T{}) 
   {
   }
 
+  explicit SignedArray(int max_size)
+    : elements(2 * max_size + 1, T{}), max_size(max_size)
+  {
+  }
+
+  // Allocated but not written, so each page is placed by the thread that first writes it
+  static SignedArray Untouched(int max_size)
+  {
+    SignedArray a;
+    a.max_size = max_size;
+    a.elements = FirstTouchVector<T>();
+    a.elements.resize(2 * max_size + 1);
+    return a;
+  }
+
+  // Resizes and resets every element
+  void resize(int max_size)
+  {
+    this->max_size = max_size;
+    elements.assign(2 * max_size + 1, T{});
+  }
+
   void set(const SignedArray& other)
   {
+    if (other.max_size != max_size) {
+      *this = other;
+      return;
+    }
     std::copy(other.elements.begin(), other.elements.end(), elements.begin());
   }
 
   // This exists so that we can index clusters by their size, and have clusters of negative size
   T& operator[](int index) 
   {
-    return elements[S + index];
+    return elements[max_size + index];
+  }
+
+  const T& operator[](int index) const
+  {
+    return elements[max_size + index];
+  }
+
+  // Element of index i is at data()[i + size()]
+  T* data() { return elements.data(); }
+  const T* data() const { return elements.data(); }
+
+  void fill(const T& value)
+  {
+    std::fill(elements.begin(), elements.end(), value);
   }
 
-  size_t size() 
+  size_t size() const
   {
-    return S;
+    return max_size;
   }
 };
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include "ssa.hpp"
+#include "../../common/thread_pool.hpp"
+#include "../../common/trace.hpp"
+
+SumTree::SumTree(int size)
+{
+  while (leaves < size) leaves *= 2;
+  sums.assign(2 * leaves, 0.0);
+}
+
+void SumTree::Set(int leaf, double weight)
+{
+  int node = leaves + leaf;
+  sums[node] = weight;
+  for (node /= 2; node >= 1; node /= 2) sums[node] = sums[2 * node] + sums[2 * node + 1];
+}
+
+int SumTree::Find(double x) const
+{
+  int node = 1;
+  while (node < leaves)
+  {
+    const int left = 2 * node;
+    if (x < sums[left] || sums[left + 1] == 0.0) node = left;
+    else
+    {
+      x -= sums[left];
+      node = left + 1;
+    }
+  }
+  return node - leaves;
+}
+
+StochasticCD::StochasticCD(const CDState& cd, double volume, std::uint64_t seed, std::uint64_t stream)
+  : cd(cd), state_size(cd.state_size), volume(volume), counts(2 * cd.state_size + 1, 0)
+{
+  if (!cd.groups.empty()) throw std::invalid_argument("Stochastic runs need every size discrete, without size groups");
+  if (!(volume > 0.0)) throw std::invalid_argument("The simulation volume must be positive");
+
+  std::seed_seq sequence{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32),
+    static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)};
+  random.seed(sequence);
+
+  const int width = 2 * state_size + 1;
+  const CDState::ReactionList& reactions = cd.reactions;
+
+  partner_start.assign(width + 1, 0);
+  for (int k : reactions.partner) ++partner_start[k + state_size + 1];
+  std::partial_sum(partner_start.begin(), partner_start.end(), partner_start.begin());
+  partner_row.resize(reactions.partner.size());
+  partner_leaf.resize(reactions.partner.size());
+
+  std::vector<int> next(partner_start.begin(), partner_start.end() - 1);
+  rows.resize(width);
+  for (int row = 0; row < width; ++row)
+  {
+    rows[row] = SumTree(reactions.row_start[row + 1] - reactions.row_start[row]);
+    for (int e = reactions.row_start[row]; e < reactions.row_start[row + 1]; ++e)
+    {
+      const int p = next[reactions.partner[e] + state_size]++;
+      partner_row[p] = row;
+      partner_leaf[p] = e - reactions.row_start[row];
+    }
+  }
+
+  channels = SumTree(NUM_CHANNELS * width);
+  for (int i = -state_size; i <= state_size; ++i)
+  {
+    if (i == 0) continue;
+    counts[i + state_size] = std::max(0L, std::lround(cd.species.C[i] * volume));
+    channels.Set(ChannelLeaf(GENERATION, i), cd.species.g[i] * volume);
+  }
+  for (int i = -state_size; i <= state_size; ++i)
+  {
+    if (i != 0) Changed(i);
+  }
+}
+
+void StochasticCD::GetConcentrations(CDState::Concentrations& C) const
+{
+  C.resize(state_size);
+  for (int i = -state_size; i <= state_size; ++i) C[i] = counts[i + state_size] / volume;
+}
+
+long StochasticCD::Run(double t_end)
+{
+  MMD_TRACE_SCOPE("update");
+  long events = 0;
+  for (;;)
+  {
+    const double total = channels.Total();
+    if (!(total > 0.0)) break;
+
+    // Exponential waiting time. Nothing fires past t_end, and as the process is memoryless the
+    // wait drawn there needn't be kept for a later Run.
+    const double wait = -std::log(1.0 - uniform(random)) / total;
+    if (t + wait >= t_end) break;
+
+    t += wait;
+    Fire(channels.Find(uniform(random) * total));
+    ++events;
+  }
+
+  t = std::max(t, t_end);
+  MMD_TRACE_COUNT("stochastic events", events);
+  return events;
+}
+
+void StochasticCD::Fire(int leaf)
+{
+  const int width = 2 * state_size + 1;
+  const Channel channel = static_cast<Channel>(leaf / width);
+  const int j = leaf % width - state_size;
+
+  switch (channel)
+  {
+  case GENERATION:
+    ++counts[j + state_size];
+    Changed(j);
+    break;
+  case SINK:
+    --counts[j + state_size];
+    Changed(j);
+    break;
+  default:
+  {
+    // Which partner reacts, in proportion to rate n_k
+    const SumTree& row = rows[j + state_size];
+    const int e = cd.reactions.row_start[j + state_size] + row.Find(uniform(random) * row.Total());
+    const int k = cd.reactions.partner[e];
+
+    --counts[j + state_size];
+    --counts[k + state_size];
+    if (j + k != 0) ++counts[j + k + state_size]; // Equal interstitial and vacancy clusters annihilate
+
+    Changed(j);
+    if (k != j) Changed(k);
+    if (j + k != 0) Changed(j + k);
+    break;
+  }
+  }
+}
+
+void StochasticCD::Changed(int i)
+{
+  const long n = counts[i + state_size];
+  for (int p = partner_start[i + state_size]; p < partner_start[i + state_size + 1]; ++p)
+  {
+    const int row = partner_row[p];
+    const int j = row - state_size;
+    const long available = j == i ? std::max(n - 1, 0L) : n; // A cluster can't react with itself
+    rows[row].Set(partner_leaf[p], cd.reactions.rate[cd.reactions.row_start[row] + partner_leaf[p]] * available);
+    UpdateRow(j);
+  }
+
+  UpdateRow(i);
+  channels.Set(ChannelLeaf(SINK, i), cd.species.K[i] * cd.C_s * n);
+}
+
+void StochasticCD::UpdateRow(int j)
+{
+  channels.Set(ChannelLeaf(REACTION, j), counts[j + state_size] * rows[j + state_size].Total() / volume);
+}
+
+long RunReplicas(const CDState& cd, const ReplicaOptions& options, double t_end, CDState::Concentrations& mean)
+{
+  std::vector<CDState::Concentrations> results(options.replicas);
+  std::vector<long> events(options.replicas, 0);
+  {
+    const unsigned threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+    ThreadPool pool(std::min<unsigned>(threads, options.replicas));
+    for (int r = 0; r < options.replicas; ++r)
+    {
+      pool.Submit([&, r] {
+        StochasticCD replica(cd, options.volume, options.seed, r);
+        events[r] = replica.Run(t_end);
+        replica.GetConcentrations(results[r]);
+      });
+    }
+    pool.Wait();
+  }
+
+  // Summed in replica order, so the mean is the same however the replicas were scheduled
+  mean.resize(cd.state_size);
+  for (const CDState::Concentrations& C : results)
+  {
+    for (int i = -cd.state_size; i <= cd.state_size; ++i) mean[i] += C[i];
+  }
+  for (int i = -cd.state_size; i <= cd.state_size; ++i) mean[i] /= options.replicas;
+
+  return std::accumulate(events.begin(), events.end(), 0L);
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "cd.hpp"
+
+// Binary tree of partial sums over non-negative weights. Setting a weight and finding the leaf a
+// point of [0, Total()) falls in both take O(log n), and every sum is recomputed from its children
+// rather than updated by differences, so the totals never drift.
+class SumTree
+{
+public:
+  SumTree() = default;
+  explicit SumTree(int size);
+
+  void Set(int leaf, double weight);
+  double Total() const { return sums[1]; }
+
+  // Leaf whose cumulative range holds x, for 0 <= x < Total(). Never a leaf of zero weight, even
+  // when rounding puts x at or past the total.
+  int Find(double x) const;
+
+private:
+  int leaves = 1; // Padded to a power of two
+  std::vector<double> sums = std::vector<double>(2, 0.0); // Root at 1, leaf i at leaves + i
+};
+
+// Stochastic cluster dynamics: the reactions of a CDState as a Markov jump process on whole
+// numbers of clusters in a simulation volume, simulated one event at a time with Gillespie's
+// direct method. Species with fewer than one cluster in the volume, which the rate equations
+// smear into fractions, appear and disappear as discrete clusters instead.
+//
+// The events are those of CDState::GetDerivatives, with the same rate coefficients: cascade
+// generation, loss to sinks and every pair in the reaction list. Dissociation isn't an event, as
+// it isn't in the rate equations either. Reaction j + k has propensity rate n_j n_k / V, or
+// rate n_j (n_j - 1) / V for j + j.
+//
+// Events are selected with two levels of SumTree, so each costs O(log N) in the number of species.
+// The top level holds the generation and sink channels and one channel per mobile row of the
+// reaction list, n_j sum_k rate_jk n_k / V. Each row has a tree of its own over the partners k,
+// without the n_j factor, so an event only updates the leaves of the few species it changes,
+// at most one per mobile row, and never the whole row.
+class StochasticCD
+{
+public:
+  // cd must be initialized, and outlive this. Its concentrations, times volume (in nm^3) and
+  // rounded, are the initial counts. Size groups aren't supported. Runs with the same seed and a
+  // different stream draw independent random numbers.
+  StochasticCD(const CDState& cd, double volume, std::uint64_t seed, std::uint64_t stream = 0);
+
+  // Fires events until t_end, or until none can happen. Returns the number fired.
+  long Run(double t_end);
+
+  double Time() const { return t; }
+  long Count(int i) const { return counts[i + state_size]; }
+  void GetConcentrations(CDState::Concentrations& C) const; // Counts per unit volume
+
+private:
+  enum Channel { GENERATION, SINK, REACTION, NUM_CHANNELS };
+
+  const CDState& cd;
+  const int state_size;
+  const double volume;
+
+  std::mt19937_64 random;
+  std::uniform_real_distribution<double> uniform{0.0, 1.0};
+  double t = 0.0;
+
+  std::vector<long> counts; // Indexed by i + state_size
+
+  SumTree channels; // Leaf channel * (2 state_size + 1) + j + state_size, see ChannelLeaf
+  std::vector<SumTree> rows; // Partners of each row of cd.reactions, indexed by j + state_size
+
+  // Where each species appears as a partner, row j + state_size and leaf e - row_start, in
+  // compressed sparse row form
+  std::vector<int> partner_start;
+  std::vector<int> partner_row, partner_leaf;
+
+  int ChannelLeaf(Channel channel, int j) const { return channel * (2 * state_size + 1) + j + state_size; }
+
+  void Fire(int leaf);
+  void Changed(int i); // Updates every weight that depends on the count of i
+  void UpdateRow(int j);
+};
+
+// Independent stochastic runs of one problem, spread over threads
+struct ReplicaOptions
+{
+  double volume = 0.0; // nm^3
+  int replicas = 1;
+  std::uint64_t seed = 1; // Replica r draws from a generator seeded with (seed, r)
+  unsigned threads = 0; // 0 for one per core
+};
+
+// Runs options.replicas copies of cd from its concentrations to t_end and sets mean to their mean
+// concentrations, which don't depend on the number of threads. Returns the total number of events.
+long RunReplicas(const CDState& cd, const ReplicaOptions& options, double t_end, CDState::Concentrations& mean);
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cmath>
+
+#include "steady.hpp"
+#include "../../common/trace.hpp"
+
+double SteadyStateSolver::ResidualNorm(const CDState::Concentrations& f, const CDState::Concentrations& C) const
+{
+  const int S = C.size();
+  double sum = 0.0;
+  for (int i = -S; i <= S; ++i)
+  {
+    const double scaled = f[i] / (tolerances.atol + tolerances.rtol * std::abs(C[i]));
+    sum += scaled * scaled;
+  }
+  return std::sqrt(sum / (2 * S + 1));
+}
+
+SteadyStateResult SteadyStateSolver::Solve(CDState& cd, double dt)
+{
+  const int S = cd.state_size;
+  for (CDState::Concentrations* a : {&C, &f, &delta, &trial, &f_trial}) {
+    if (static_cast<int>(a->size()) != S) a->resize(S);
+  }
+  cd.InitJacobian(J);
+  if (!(dt > 0.0)) dt = FIRST_DT;
+
+  cd.GetConcentrations(C);
+  cd.GetDerivatives(C, f);
+  double residual = ResidualNorm(f, C);
+
+  SteadyStateResult result;
+  for (result.iterations = 1; result.iterations <= MAX_ITERATIONS; ++result.iterations)
+  {
+    MMD_TRACE_SCOPE("steady state iteration");
+    cd.GetJacobian(C, J);
+    M.Factor(J, dt);
+
+    for (int i = -S; i <= S; ++i) delta[i] = dt * f[i];
+    M.Solve(delta.data());
+
+    // A step that overshoots further than atol below zero, or breaks down, is retried shorter.
+    // Smaller overshoots are kept until the end, as clamping them would stall Newton.
+    bool usable = true;
+    ErrorNorm change(tolerances);
+    int largest = 0;
+    double largest_change = 0.0;
+    for (int i = -S; i <= S; ++i)
+    {
+      trial[i] = C[i] + delta[i];
+      if (!(trial[i] >= -tolerances.atol)) usable = false;
+
+      const double scaled = std::abs(delta[i]) / (tolerances.atol + tolerances.rtol * std::abs(C[i]));
+      if (scaled > largest_change)
+      {
+        largest = i;
+        largest_change = scaled;
+      }
+      change.Add(delta[i], C[i], trial[i]);
+    }
+    trial[0] = 0.0;
+
+    if (!usable)
+    {
+      MMD_TRACE_COUNT("steady state rejections", 1);
+      dt /= 10;
+      if (dt < MIN_DT) break;
+      continue;
+    }
+
+    cd.GetDerivatives(trial, f_trial);
+    const double trial_residual = ResidualNorm(f_trial, trial);
+
+    C.set(trial);
+    f.set(f_trial);
+    result.slowest = largest;
+    if (dt >= STEADY_DT && change.Value() <= 1.0)
+    {
+      result.converged = true;
+      residual = trial_residual;
+      break;
+    }
+
+    // Switched evolution relaxation, growth limited so one lucky step doesn't jump straight to
+    // Newton far from the solution. Near the solution the residual stalls at round off, so a step
+    // within tolerance always lengthens the next.
+    const double ratio = trial_residual > 0.0 ? residual / trial_residual : 100.0;
+    double growth = std::clamp(ratio, 0.1, 100.0);
+    if (change.Value() <= 1.0) growth = std::max(growth, 10.0);
+    dt = std::min(MAX_DT, dt * growth);
+    residual = trial_residual;
+  }
+
+  // Undo the overshoots below zero that were within tolerance
+  for (int i = -S; i <= S; ++i) C[i] = std::max(C[i], 0.0);
+  cd.SetConcentrations(C);
+  result.iterations = std::min(result.iterations, MAX_ITERATIONS);
+  result.residual = residual;
+  result.dt = dt;
+  return result;
+}
\ No newline at end of file
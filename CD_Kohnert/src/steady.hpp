@@ -0,0 +1,46 @@
+#pragma once
+
+#include "cd.hpp"
+#include "../../common/adaptive.hpp"
+
+// Direct solution of dC/dt = 0, for when only the long time limit of a run is wanted.
+//
+// Pseudo-transient continuation: each iteration is a backward Euler step of length dt,
+// (I - dt J) delta = dt f(C), solved with the same analytic Jacobian and linear time factorization
+// as the implicit integrators. dt grows as the residual falls (switched evolution relaxation),
+// so the first iterations follow the transient robustly and the last are plain Newton steps.
+struct SteadyStateResult
+{
+  bool converged = false;
+  int iterations = 0;
+  double residual = 0.0; // Weighted RMS of dC/dt at the end, see ResidualNorm
+  double dt = 0.0; // Pseudo time step reached
+  int slowest = 0; // Size that changed most in the last iteration, relative to tolerance
+};
+
+class SteadyStateSolver
+{
+public:
+  static constexpr int MAX_ITERATIONS = 1000;
+  static constexpr double STEADY_DT = 1e20; // Steps at least this long leave a steady state unchanged
+  static constexpr double MAX_DT = 1e30;
+  static constexpr double MIN_DT = 1e-30;
+  static constexpr double FIRST_DT = 1e-6; // When Solve is given no dt
+
+  explicit SteadyStateSolver(const Tolerances& tol) : tolerances(tol) {}
+
+  // Iterates cd's concentrations to the steady state, starting from where they are with a pseudo
+  // time step dt (FIRST_DT if not positive). Converged once a step of at least STEADY_DT changes them by less than the
+  // tolerances.
+  SteadyStateResult Solve(CDState& cd, double dt);
+
+private:
+  Tolerances tolerances;
+
+  Jacobian J;
+  NewtonMatrix M;
+  CDState::Concentrations C, f, delta, trial, f_trial;
+
+  // RMS of f scaled by atol + rtol |C|, what the continuation drives to zero
+  double ResidualNorm(const CDState::Concentrations& f, const CDState::Concentrations& C) const;
+};
\ No newline at end of file
@@ -2,94 +2,265 @@
 #include <iomanip>
 #include <numeric>
 #include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 
 #define _USE_MATH_DEFINES
 #include <cmath>
 
 #include "cd.hpp"
+#include "../../common/trace.hpp"
 
 //-----------------------------------------------------------------
 // Simulation Functions
 //-----------------------------------------------------------------
 
-void CDState::Init()
+template <typename Real>
+BasicCDState<Real>::BasicCDState(int num_cluster_sizes)
+  : num_cluster_sizes(num_cluster_sizes),
+    i_concentrations(num_cluster_sizes, 0.0),
+    v_concentrations(num_cluster_sizes, 0.0),
+    y(2 * num_cluster_sizes + 1),
+    y_new(2 * num_cluster_sizes + 1),
+    dydt(2 * num_cluster_sizes + 1)
 {
+}
+
+template <typename Real>
+void BasicCDState<Real>::Init()
+{
+  interstitial_migration = ArrheniusTable::Get(ValueOf(E_mi), k);
+  vacancy_migration = ArrheniusTable::Get(ValueOf(E_mv), k);
+  SetTemperature(T);
+
+  // Tabulate the size dependent terms once, the flux kernel reads sizes up to num_cluster_sizes + 2
+  const int num_sizes = num_cluster_sizes + 3;
+  i_coefficients.resize(num_sizes);
+  v_coefficients.resize(num_sizes);
 
+  for (int n = 0; n < num_sizes; ++n)
+  {
+    i_coefficients.G[n] = G_i(n);
+    i_coefficients.alpha[n] = alpha_ii(n);
+    i_coefficients.beta_cross[n] = beta_iv(n);
+    i_coefficients.beta_self[n] = beta_ii(n);
+    i_coefficients.beta_self_prev[n] = n < num_cluster_sizes ? beta_ii(n - 1) : 0.0;
+
+    v_coefficients.G[n] = G_v(n);
+    v_coefficients.alpha[n] = alpha_vv(n);
+    v_coefficients.beta_cross[n] = beta_vi(n);
+    v_coefficients.beta_self[n] = beta_vv(n);
+    v_coefficients.beta_self_prev[n] = n < num_cluster_sizes ? beta_vv(n - 1) : 0.0;
+  }
 }
 
-void CDState::Step(double dt)
+template <typename Real>
+void BasicCDState<Real>::SetTemperature(double T)
 {
-  double dCi1 = 0.0 * dt; // TODO - Eq 3a in Pokor
-  double dCv1 = 0.0 * dt; // ^
+  this->T = T;
+  if constexpr (std::is_same_v<Real, double>)
+  {
+    D_i = D_0i * (*interstitial_migration)(T);
+    D_v = D_0v * (*vacancy_migration)(T);
+  }
+  else // The tables have no derivatives with respect to the energies
+  {
+    D_i = D_0i * exp(-E_mi / (k * T));
+    D_v = D_0v * exp(-E_mv / (k * T));
+  }
+  R_iv = 4 * M_PI * (D_i + D_v) * r_iv; // TODO - Pokor Eq 3d
+}
 
-  i_concentrations_swap[0] += dCi1;
-  v_concentrations_swap[0] += dCv1;
+template <typename Real>
+void BasicCDState<Real>::SetMaterial(const Material& material)
+{
+  for (int p = 0; p < NUM_PARAMETERS; ++p)
+  {
+    const double value = material.*MATERIAL_FIELDS[p];
+    if constexpr (std::is_same_v<Real, double>) Parameter(p) = value;
+    else Parameter(p) = Real::Variable(value, p);
+  }
+}
 
-  for (int n = 1; n <= NUM_CLUSTER_SIZES; ++n) // Compute the change in concentration for each cluster size
+template <typename Real>
+void BasicCDState<Real>::SetDoseRate(double dose_rate)
+{
+  this->dose_rate = dose_rate;
+  for (size_t n = 0; n < i_coefficients.G.size(); ++n)
   {
-    i_concentrations_swap[n] += dCi(n, dt);
-    v_concentrations_swap[n] += dCv(n, dt);
+    i_coefficients.G[n] = G_i(n);
+    v_coefficients.G[n] = G_v(n);
   }
+}
 
-  rho += dRho(dt);
+template <typename Real>
+void BasicCDState<Real>::Step(double dt)
+{
+  MMD_TRACE_SCOPE("update");
+  GetState(y);
+  GetDerivatives(y, dydt);
+
+  if constexpr (std::is_same_v<Real, double>)
+  {
+    if (compensated)
+    {
+      compensation.resize(y.size(), 0.0);
+      for (size_t i = 0; i < y.size(); ++i) Accumulate<CompensatedPrecision>(y[i], compensation[i], dydt[i] * dt);
+    }
+    else for (size_t i = 0; i < y.size(); ++i) y[i] += dydt[i] * dt;
+  }
+  else for (size_t i = 0; i < y.size(); ++i) y[i] += dydt[i] * dt;
 
-  std::swap(i_concentrations, i_concentrations_swap); // TODO - These two lines do not need to be O(NUM_CLUSTER_SIZES)
-  std::swap(v_concentrations, v_concentrations_swap);
+  SetState(y);
+  MMD_TRACE_COUNT("steps", 1);
+  CheckFinite();
 }
 
-double CDState::C_i(int n)
+template <typename Real>
+double BasicCDState<Real>::AdaptiveStep(double t, double t_end, double& dt)
 {
-  if (n < 1 || n > NUM_CLUSTER_SIZES) return 0.0;
-  return i_concentrations[n - 1];
+  GetState(y);
+
+  auto rhs = [this](const State& state, State& derivatives) { GetDerivatives(state, derivatives); };
+
+  MMD_TRACE_SCOPE("update");
+  for (;;)
+  {
+    const bool last = t + dt >= t_end;
+    const double h = last ? t_end - t : dt;
+
+    double error = DormandPrinceStep(rhs, y, y_new, h, tolerances, dopri_work);
+    double next_dt = controller.NextDt(h, error);
+
+    if (StepController::Accept(error))
+    {
+      SetState(y_new);
+      MMD_TRACE_COUNT("steps", 1);
+      CheckFinite();
+      if (!last || next_dt < dt) dt = next_dt; // Don't let a short final step shrink dt
+      return last ? t_end : t + h;
+    }
+
+    MMD_TRACE_COUNT("rejected steps", 1);
+    dt = next_dt;
+    if (t + dt == t) throw std::runtime_error("Adaptive step size underflow at t = " + std::to_string(t));
+  }
 }
 
-double CDState::C_v(int n)
+template <typename Real>
+void BasicCDState<Real>::CheckFinite() const
 {
-  if (n < 1 || n > NUM_CLUSTER_SIZES) return 0.0;
-  return v_concentrations[n - 1];
+  // Species are reported as their index in State, the derivatives of a Dual aren't checked
+  if constexpr (std::is_same_v<Real, double>)
+  {
+    MMD_TRACE_CHECK_FINITE("CD_Pokor interstitials", i_concentrations.data(), num_cluster_sizes, 0);
+    MMD_TRACE_CHECK_FINITE("CD_Pokor vacancies", v_concentrations.data(), num_cluster_sizes, num_cluster_sizes);
+  }
+}
+
+template <typename Real>
+void BasicCDState<Real>::GetState(State& y) const
+{
+  std::copy(i_concentrations.begin(), i_concentrations.end(), y.begin());
+  std::copy(v_concentrations.begin(), v_concentrations.end(), y.begin() + num_cluster_sizes);
+  y[2 * num_cluster_sizes] = rho;
+}
+
+template <typename Real>
+void BasicCDState<Real>::SetState(const State& y)
+{
+  std::copy(y.begin(), y.begin() + num_cluster_sizes, i_concentrations.begin());
+  std::copy(y.begin() + num_cluster_sizes, y.begin() + 2 * num_cluster_sizes, v_concentrations.begin());
+  rho = y[2 * num_cluster_sizes];
 }
 
-double CDState::dCi1(double dt)
+template <typename Real>
+void BasicCDState<Real>::GetDerivatives(const State& y, State& dydt) const
 {
-  double D_i = D_0i * std::exp(-E_mi / (k * T));
-  double D_v = D_0v * std::exp(-E_mv / (k * T));
+  MMD_TRACE_SCOPE("rates");
+  // Shift the pointers so both are indexed by cluster size
+  const Real* C_i = y.data() - 1;
+  const Real* C_v = y.data() + num_cluster_sizes - 1;
+  Real* dC_i = dydt.data() - 1;
+  Real* dC_v = dydt.data() + num_cluster_sizes - 1;
+
+  dC_i[1] = 0.0; // TODO - Eq 3a in Pokor, see dCi1
+  dC_v[1] = 0.0; // ^ dCv1
+
+  TridiagonalFlux(i_coefficients, C_i[1], C_v[1], C_i, dC_i, 2, num_cluster_sizes);
+  TridiagonalFlux(v_coefficients, C_v[1], C_i[1], C_v, dC_v, 2, num_cluster_sizes);
+
+  dydt[2 * num_cluster_sizes] = dRho();
+}
+
+template <typename Real>
+void BasicCDState<Real>::GetDerivativesScalar(const State& y, State& dydt)
+{
+  SetState(y);
+
+  dydt[0] = 0.0; // TODO - Eq 3a in Pokor, see dCi1
+  dydt[num_cluster_sizes] = 0.0; // ^ dCv1
 
-  double R_iv = 4 * M_PI * (D_i + D_v) * r_iv; // TODO - Pokor Eq 3d
+  for (int n = 2; n <= num_cluster_sizes; ++n) // Compute the change in concentration for each cluster size
+  {
+    dydt[n - 1] = dCi(n);
+    dydt[num_cluster_sizes + n - 1] = dCv(n);
+  }
+
+  dydt[2 * num_cluster_sizes] = dRho();
+}
+
+template <typename Real>
+Real BasicCDState<Real>::C_i(int n)
+{
+  if (n < 1 || n > num_cluster_sizes) return 0.0;
+  return i_concentrations[n - 1];
+}
 
-  return (G_i(1) - R_iv * C_i(1) * C_v(1) - C_i(1) / ta_gbi() - C_i(1) / ta_i() - C_i(1) / ta_i() + 1 / te_i()) * dt;
+template <typename Real>
+Real BasicCDState<Real>::C_v(int n)
+{
+  if (n < 1 || n > num_cluster_sizes) return 0.0;
+  return v_concentrations[n - 1];
 }
 
-double CDState::dCv1(double dt)
+template <typename Real>
+Real BasicCDState<Real>::dCi1()
 {
-  double D_i = D_0i * std::exp(-E_mi / (k * T));
-  double D_v = D_0v * std::exp(-E_mv / (k * T));
+  return (G_i(1) - R_iv * C_i(1) * C_v(1) - C_i(1) / ta_gbi() - C_i(1) / ta_i() - C_i(1) / ta_i() + 1 / te_i());
+}
 
-  double R_iv = 4 * M_PI * (D_i + D_v) * r_iv;
-  return (G_i(1) - R_iv * C_i(0) * C_v(0)) * dt;
+template <typename Real>
+Real BasicCDState<Real>::dCv1()
+{
+  return G_i(1) - R_iv * C_i(0) * C_v(0);
 }
 
-double CDState::dCi(int n, double dt)
+template <typename Real>
+Real BasicCDState<Real>::dCi(int n)
 {
-  return (G_i(n + 1) + a_i(n + 1) * C_i(n - 1) - b_i(n) * C_i(n) + c_i(n) * C_i(n + 1)) * dt;
+  return G_i(n + 1) + a_i(n + 1) * C_i(n - 1) - b_i(n) * C_i(n) + c_i(n) * C_i(n + 1);
 }
 
-double CDState::dCv(int n, double dt)
+template <typename Real>
+Real BasicCDState<Real>::dCv(int n)
 {
-  return (G_v(n + 1) + a_v(n + 1) * C_v(n - 1) - b_v(n) * C_v(n) + c_v(n) * C_v(n + 1)) * dt;
+  return G_v(n + 1) + a_v(n + 1) * C_v(n - 1) - b_v(n) * C_v(n) + c_v(n) * C_v(n + 1);
 }
 
-double CDState::dRho(double dt) {
+template <typename Real>
+Real BasicCDState<Real>::dRho() const {
   return 1.0; // TODO - Sakaguchi Eq 3.14
 }
 
-double CDState::G_i(int n)
+template <typename Real>
+Real BasicCDState<Real>::G_i(int n)
 {
   // See Table 5 in Pokor
   const double nu = 0.3;
-  const double G_dpa = 2.9 * std::pow(10, -7);
-  const double fi2 = 0.5;
-  const double fi3 = 0.2;
-  const double fi4 = 0.06;
+  const double G_dpa = 2.9 * std::pow(10, -7) * dose_rate;
 
   switch(n)
   {
@@ -106,14 +277,12 @@ double CDState::G_i(int n)
   }
 }
 
-double CDState::G_v(int n)
+template <typename Real>
+Real BasicCDState<Real>::G_v(int n)
 {
   // See Table 5 in Pokor
   const double nu = 0.3;
-  const double G_dpa = 2.9 * std::pow(10, -7);
-  const double fv2 = 0.06;
-  const double fv3 = 0.03;
-  const double fv4 = 0.02;
+  const double G_dpa = 2.9 * std::pow(10, -7) * dose_rate;
 
   switch(n)
   {
@@ -130,82 +299,103 @@ double CDState::G_v(int n)
   }
 }
 
-double CDState::a_i(int n)
+template <typename Real>
+Real BasicCDState<Real>::a_i(int n)
 {
   return beta_iv(n + 1) * C_v(1) + alpha_ii(n + 1);
 }
 
-double CDState::b_i(int n)
+template <typename Real>
+Real BasicCDState<Real>::b_i(int n)
 {
   return beta_iv(n + 1) * C_v(1) + beta_ii(n) * C_i(1) + alpha_ii(n);
 }
 
-double CDState::c_i(int n)
+template <typename Real>
+Real BasicCDState<Real>::c_i(int n)
 {
   return beta_ii(n - 1) * C_i(1);
 }
 
-double CDState::a_v(int n)
+template <typename Real>
+Real BasicCDState<Real>::a_v(int n)
 {
   return beta_vi(n + 1) * C_i(1) + alpha_vv(n + 1);
 }
 
-double CDState::b_v(int n)
+template <typename Real>
+Real BasicCDState<Real>::b_v(int n)
 {
   return beta_vi(n + 1) * C_i(1) + beta_vv(n) * C_v(1) + alpha_vv(n);
 }
 
-double CDState::c_v(int n)
+template <typename Real>
+Real BasicCDState<Real>::c_v(int n)
 {
   return beta_vv(n - 1) * C_v(1);
 }
 
-double CDState::alpha_ii(int n) {
+template <typename Real>
+Real BasicCDState<Real>::alpha_ii(int n) {
   return 1.0; // TODO - Pokor Eq 4a-f
 }
-double CDState::alpha_vv(int n) {
+template <typename Real>
+Real BasicCDState<Real>::alpha_vv(int n) {
   return 1.0; // TODO - Pokor Eq 4a-f
 }
 
-double CDState::beta_iv(int n) {
+template <typename Real>
+Real BasicCDState<Real>::beta_iv(int n) {
   return 1.0; // TODO - Pokor Eq 4a-f
 }
-double CDState::beta_vi(int n) {
+template <typename Real>
+Real BasicCDState<Real>::beta_vi(int n) {
   return 1.0; // TODO - Pokor Eq 4a-f
 }
-double CDState::beta_ii(int n) {
+template <typename Real>
+Real BasicCDState<Real>::beta_ii(int n) {
   return 1.0; // TODO - Pokor Eq 4a-f
 }
-double CDState::beta_vv(int n) {
+template <typename Real>
+Real BasicCDState<Real>::beta_vv(int n) {
   return 1.0; // TODO - Pokor Eq 4a-f
 }
 
-double CDState::ta_gbi()
+template <typename Real>
+Real BasicCDState<Real>::ta_gbi()
 {
   return 1.0; // TODO - Pokor Eq 3f
 }
 
-double CDState::ta_gbv()
+template <typename Real>
+Real BasicCDState<Real>::ta_gbv()
 {
   return 1.0; // TODO - Pokor Eq 3f
 }
 
-double CDState::ta_i()
+template <typename Real>
+Real BasicCDState<Real>::ta_i()
 {
   return 1.0; // TODO - Pokor Eq 3c
 }
 
-double CDState::ta_v()
+template <typename Real>
+Real BasicCDState<Real>::ta_v()
 {
   return 1.0; // TODO - Pokor Eq 3c
 }
 
-double CDState::te_i()
+template <typename Real>
+Real BasicCDState<Real>::te_i()
 {
   return 1.0; // TODO - Pokor Eq 3b
 }
 
-double CDState::te_v()
+template <typename Real>
+Real BasicCDState<Real>::te_v()
 {
   return 1.0; // TODO - Pokor Eq 3b
-}
\ No newline at end of file
+}
+
+template class BasicCDState<double>;
+template class BasicCDState<PokorDual>;
\ No newline at end of file
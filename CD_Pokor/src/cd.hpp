@@ -2,65 +2,175 @@
 
 #include <array>
 #include <cmath>
+#include <memory>
 
-class CDState 
+#include "../../common/adaptive.hpp"
+#include "../../common/aligned_allocator.hpp"
+#include "../../common/arrhenius.hpp"
+#include "../../common/dual.hpp"
+#include "../../common/material.hpp"
+#include "../../common/precision.hpp"
+#include "flux.hpp"
+
+// Real is the type of the concentrations and material parameters: double for a plain run, or a
+// Dual (common/dual.hpp) to carry their derivatives with respect to the parameters through the
+// run, see SensitivityState. Time stays double either way.
+template <typename Real>
+class BasicCDState 
 {
 public:
-  static constexpr size_t NUM_CLUSTER_SIZES = 20;
+  static constexpr int DEFAULT_NUM_CLUSTER_SIZES = 20;
+  static constexpr double DEFAULT_T = 300.0;
+
+  // Interstitial concentrations, then vacancy concentrations, then rho
+  using State = AlignedVector<Real>;
+
+  const int num_cluster_sizes;
+  double T = DEFAULT_T; // Temperature in Kelvin, set before Init (or through SetTemperature after)
+  double dose_rate = 1.0; // Relative to the nominal G_dpa, set before Init (or through SetDoseRate after)
+  bool compensated = false; // Step adds its updates under CompensatedPrecision (common/precision.hpp), double states only
   
-  std::array<double, NUM_CLUSTER_SIZES> i_concentrations {0.0};
-  std::array<double, NUM_CLUSTER_SIZES> v_concentrations {0.0};
+  AlignedVector<Real> i_concentrations; // Index n - 1 holds size n
+  AlignedVector<Real> v_concentrations;
+
+  // Material parameters, set before Init, by default those of SA304 (common/material.hpp)
+  Real r_iv = SA304.r_iv; // i/v reaction radius in cm
+  Real D_0i = SA304.D_0i; // cm^2/s
+  Real D_0v = SA304.D_0v; // cm^2/s
+  Real E_mi = SA304.E_mi; // Interstitial migration energy in eV
+  Real E_mv = SA304.E_mv; // Interstitial migration energy in eV
+
+  // Fractions of the cascade defects produced as clusters of 2, 3 and 4, see Table 5 in Pokor
+  Real fi2 = SA304.fi2;
+  Real fi3 = SA304.fi3;
+  Real fi4 = SA304.fi4;
+  Real fv2 = SA304.fv2;
+  Real fv3 = SA304.fv3;
+  Real fv4 = SA304.fv4;
+
+  // The material parameters by index, for seeding sensitivities, and where each comes from in a Material
+  static constexpr int NUM_PARAMETERS = 11;
+  static constexpr std::array<const char*, NUM_PARAMETERS> PARAMETER_NAMES = {"r_iv", "D_0i", "D_0v", "E_mi", "E_mv", "fi2", "fi3", "fi4", "fv2", "fv3", "fv4"};
+  static constexpr std::array<double Material::*, NUM_PARAMETERS> MATERIAL_FIELDS = {&Material::r_iv, &Material::D_0i, &Material::D_0v,
+    &Material::E_mi, &Material::E_mv, &Material::fi2, &Material::fi3, &Material::fi4, &Material::fv2, &Material::fv3, &Material::fv4};
+  // Whether the equations depend on each parameter at all. The monomer equations (dCi1, dCv1) are
+  // still TODO, and they are the only ones that read R_iv, and so r_iv, D_0 and E_m, or the size 2
+  // fractions: dCi(n) takes its generation from G_i(n + 1). The others have zero derivatives by
+  // construction, so printSensitivities leaves them out.
+  static constexpr std::array<bool, NUM_PARAMETERS> PARAMETER_USED = {false, false, false, false, false, false, true, true, false, true, true};
+  Real& Parameter(int index)
+  {
+    Real* const parameters[NUM_PARAMETERS] = {&r_iv, &D_0i, &D_0v, &E_mi, &E_mv, &fi2, &fi3, &fi4, &fv2, &fv3, &fv4};
+    return *parameters[index];
+  }
+
+  // Sets every material parameter, before Init. The material must define all of MATERIAL_FIELDS.
+  // A Dual state seeds them as its variables again.
+  void SetMaterial(const Material& material);
+
+  explicit BasicCDState(int num_cluster_sizes = DEFAULT_NUM_CLUSTER_SIZES);
 
   void Init(); // TODO - Get input parameters through here
   void Step(double dt);
 
-  double C_i(int n);
-  double C_v(int n);
+  // Moves an initialized state to temperature T, with the diffusion constants read from shared
+  // Arrhenius tables rather than recomputed
+  void SetTemperature(double T);
+  void SetDoseRate(double dose_rate); // Rescales the generation terms
+
+  // Takes one error controlled Dormand-Prince step from t, never past t_end. dt is the step to
+  // try and is updated with the step to try next. Returns the time reached.
+  double AdaptiveStep(double t, double t_end, double& dt);
+  void SetTolerances(const Tolerances& tol) { tolerances = tol; }
+
+  // Step controller state between adaptive steps, so one state can step several cells in turn
+  double ControllerMemory() const { return controller.Memory(); }
+  void SetControllerMemory(double error) { controller.SetMemory(error); }
+
+  // Monomer diffusion constants in cm^2/s at the current temperature
+  Real InterstitialDiffusivity() const { return D_i; }
+  Real VacancyDiffusivity() const { return D_v; }
+
+  void GetState(State& y) const;
+  void SetState(const State& y);
+
+  // dy/dt at y, evaluated for all sizes at once from the coefficient tables built by Init
+  void GetDerivatives(const State& y, State& dydt) const;
+
+  // Reference evaluation of GetDerivatives through the per-size rate functions (dCi, dCv, ...).
+  // Loads y into the state, since those read the current concentrations.
+  void GetDerivativesScalar(const State& y, State& dydt);
+
+  Real C_i(int n);
+  Real C_v(int n);
 
 private:
   static constexpr double k = 8.6173 * 0.00005; //eV K^-1 k is the Boltzmann constant
 
-  static constexpr double T = 300.0; // Temperature in Kelvin
-  static constexpr double r_iv = 0.00000007; // i/v reaction radius in cm
-  static constexpr double D_0i = 0.001; // cm^2/s
-  static constexpr double D_0v = 0.6; // cm^2/s
-  static constexpr double E_mi = 0.45; // Interstitial migration energy in eV
-  static constexpr double E_mv = 1.35; // Interstitial migration energy in eV
-
-  std::array<double, NUM_CLUSTER_SIZES> i_concentrations_swap {0.0};
-  std::array<double, NUM_CLUSTER_SIZES> v_concentrations_swap {0.0};
-
-  double rho = 0.0; // Dislocation network density
-
-  double dCi1(double dt);
-  double dCv1(double dt);
-
-  double dCi(int n, double dt);
-  double dCv(int n, double dt);
-  double dRho(double dt);
-
-  double G_i(int n); // Interstitial cluster generation term
-  double G_v(int n); // Vacancy cluster generation term
-
-  double a_i(int n); 
-  double b_i(int n);
-  double c_i(int n);
-  double a_v(int n); 
-  double b_v(int n);
-  double c_v(int n);
-
-  double alpha_ii(int n);
-  double alpha_vv(int n);
-
-  double beta_iv(int n);
-  double beta_vi(int n);
-  double beta_ii(int n);
-  double beta_vv(int n);
-
-  double ta_gbi();
-  double ta_gbv();
-  double ta_i();
-  double ta_v();
-  double te_i();
-  double te_v();
+  Real rho = 0.0; // Dislocation network density
+
+  // Temperature dependent, set by Init and SetTemperature
+  std::shared_ptr<const ArrheniusTable> interstitial_migration, vacancy_migration;
+  Real D_i = 0.0; // Interstitial diffusion constant
+  Real D_v = 0.0; // Vacancy diffusion constant
+  Real R_iv = 0.0; // i/v recombination rate
+
+  BasicFluxCoefficients<Real> i_coefficients;
+  BasicFluxCoefficients<Real> v_coefficients;
+
+  Tolerances tolerances;
+  StepController controller{4};
+  State y, y_new, dydt; // Step work arrays
+  State compensation; // What rounding has dropped from the state in compensated Steps
+  DormandPrinceWork<State> dopri_work;
+
+  void CheckFinite() const; // Reports non-finite concentrations to common/trace.hpp, when compiled in
+
+  // Rates of change per second
+  Real dCi1();
+  Real dCv1();
+
+  Real dCi(int n);
+  Real dCv(int n);
+  Real dRho() const;
+
+  Real G_i(int n); // Interstitial cluster generation term
+  Real G_v(int n); // Vacancy cluster generation term
+
+  Real a_i(int n); 
+  Real b_i(int n);
+  Real c_i(int n);
+  Real a_v(int n); 
+  Real b_v(int n);
+  Real c_v(int n);
+
+  Real alpha_ii(int n);
+  Real alpha_vv(int n);
+
+  Real beta_iv(int n);
+  Real beta_vi(int n);
+  Real beta_ii(int n);
+  Real beta_vv(int n);
+
+  Real ta_gbi();
+  Real ta_gbv();
+  Real ta_i();
+  Real ta_v();
+  Real te_i();
+  Real te_v();
+};
+
+using CDState = BasicCDState<double>;
+
+// A state that carries dC/dθ for every material parameter θ (PARAMETER_NAMES) through a single
+// run, with the parameters seeded as the variables. Built in cd.cpp next to CDState.
+using PokorDual = Dual<CDState::NUM_PARAMETERS>;
+class SensitivityState : public BasicCDState<PokorDual>
+{
+public:
+  explicit SensitivityState(int num_cluster_sizes = DEFAULT_NUM_CLUSTER_SIZES)
+    : BasicCDState<PokorDual>(num_cluster_sizes)
+  {
+    for (int p = 0; p < NUM_PARAMETERS; ++p) Parameter(p) = PokorDual::Variable(ValueOf(Parameter(p)), p);
+  }
 };
\ No newline at end of file
@@ -0,0 +1,46 @@
+#if __has_include(<experimental/simd>) && !defined(POKOR_NO_SIMD)
+#include <experimental/simd>
+#define POKOR_SIMD 1
+#endif
+
+#include "flux.hpp"
+
+void TridiagonalFlux(const FluxCoefficients& coefficients, double C_self1, double C_cross1, const double* C, double* dC, int first, int last)
+{
+  const double* G = coefficients.G.data();
+  const double* alpha = coefficients.alpha.data();
+  const double* beta_cross = coefficients.beta_cross.data();
+  const double* beta_self = coefficients.beta_self.data();
+  const double* beta_self_prev = coefficients.beta_self_prev.data();
+
+  int n = first;
+
+#ifdef POKOR_SIMD
+  namespace stdx = std::experimental;
+  using simd = stdx::native_simd<double>;
+  constexpr int width = simd::size();
+
+  const simd self1 = C_self1;
+  const simd cross1 = C_cross1;
+
+  for (; n + width - 1 <= last; n += width)
+  {
+    const simd g(G + n + 1, stdx::element_aligned);
+    const simd a = simd(beta_cross + n + 2, stdx::element_aligned) * cross1 + simd(alpha + n + 2, stdx::element_aligned);
+    const simd b = simd(beta_cross + n + 1, stdx::element_aligned) * cross1 + simd(beta_self + n, stdx::element_aligned) * self1 + simd(alpha + n, stdx::element_aligned);
+    const simd c = simd(beta_self_prev + n, stdx::element_aligned) * self1;
+
+    const simd result = g + a * simd(C + n - 1, stdx::element_aligned) - b * simd(C + n, stdx::element_aligned) + c * simd(C + n + 1, stdx::element_aligned);
+    result.copy_to(dC + n, stdx::element_aligned);
+  }
+#endif
+
+  for (; n <= last; ++n) // Remainder, or everything without SIMD
+  {
+    const double a = beta_cross[n + 2] * C_cross1 + alpha[n + 2];
+    const double b = beta_cross[n + 1] * C_cross1 + beta_self[n] * C_self1 + alpha[n];
+    const double c = beta_self_prev[n] * C_self1;
+
+    dC[n] = G[n + 1] + a * C[n - 1] - b * C[n] + c * C[n + 1];
+  }
+}
\ No newline at end of file
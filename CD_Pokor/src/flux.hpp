@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../../common/aligned_allocator.hpp"
+
+// Size dependent coefficients of the cluster master equation for one defect type (interstitial
+// or vacancy), tabulated for sizes 0..num_cluster_sizes + 2 so the flux kernel can stream them.
+// "self" is the defect type being updated and "cross" the opposite one.
+template <typename Real>
+struct BasicFluxCoefficients
+{
+  AlignedVector<Real> G; // Generation, G_x(n)
+  AlignedVector<Real> alpha; // Emission, alpha_xx(n)
+  AlignedVector<Real> beta_cross; // Absorption of the opposite monomer, beta_xy(n)
+  AlignedVector<Real> beta_self; // Absorption of the same monomer, beta_xx(n)
+  AlignedVector<Real> beta_self_prev; // beta_xx(n - 1), zero at the largest size since there is no size above it
+
+  void resize(int num_sizes)
+  {
+    G.assign(num_sizes, 0.0);
+    alpha.assign(num_sizes, 0.0);
+    beta_cross.assign(num_sizes, 0.0);
+    beta_self.assign(num_sizes, 0.0);
+    beta_self_prev.assign(num_sizes, 0.0);
+  }
+};
+
+using FluxCoefficients = BasicFluxCoefficients<double>;
+
+// dC[n] = G(n + 1) + a(n + 1) C[n - 1] - b(n) C[n] + c(n) C[n + 1] for n in [first, last], with
+//   a(n) = beta_cross(n + 1) C_cross1 + alpha(n + 1)
+//   b(n) = beta_cross(n + 1) C_cross1 + beta_self(n) C_self1 + alpha(n)
+//   c(n) = beta_self(n - 1) C_self1
+// C and dC are indexed by cluster size. C[last + 1] is read but only ever multiplied by
+// beta_self_prev at the largest size, which is zero. Uses std::experimental::simd when available.
+void TridiagonalFlux(const FluxCoefficients& coefficients, double C_self1, double C_cross1, const double* C, double* dC, int first, int last);
+
+// The same flux as a plain loop, for scalar types other than double such as the dual numbers of
+// a sensitivity run
+template <typename Real>
+void TridiagonalFlux(const BasicFluxCoefficients<Real>& coefficients, const Real& C_self1, const Real& C_cross1, const Real* C, Real* dC, int first, int last)
+{
+  for (int n = first; n <= last; ++n)
+  {
+    const Real a = coefficients.beta_cross[n + 2] * C_cross1 + coefficients.alpha[n + 2];
+    const Real b = coefficients.beta_cross[n + 1] * C_cross1 + coefficients.beta_self[n] * C_self1 + coefficients.alpha[n];
+    const Real c = coefficients.beta_self_prev[n] * C_self1;
+
+    dC[n] = coefficients.G[n + 1] + a * C[n - 1] - b * C[n] + c * C[n + 1];
+  }
+}
\ No newline at end of file
@@ -1,30 +1,292 @@
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "cd.hpp"
+#include "spatial.hpp"
+#include "../../common/schedule.hpp"
+#include "../../common/trace.hpp"
 
-void runCD(double dt, double total_time)
+struct RunOptions
 {
-  CDState cd;
+  double dt = 0.0; // Fixed step, or the first step to try when adaptive
+  double total_time = 0.0;
+  int num_cluster_sizes = CDState::DEFAULT_NUM_CLUSTER_SIZES;
+  bool adaptive = false;
+  bool sensitivities = false; // Also compute dC/dθ for every material parameter θ
+  bool compensated = false; // Fixed steps add their updates with compensated sums, see common/precision.hpp
+  Material material = SA304;
+  Tolerances tolerances;
 
+  std::shared_ptr<const Schedule> schedule; // Temperature and dose rate over the run, if they change
+
+  bool spatial = false; // Run on a grid of cells, see spatial.hpp
+  SpatialOptions grid;
+  std::string profile_file = "profile.csv"; // Final concentrations of every cell, when spatial
+};
+
+// Runs cd, a CDState, SensitivityState or SpatialCD, from 0 to options.total_time
+template <typename State>
+void runCD(State& cd, const RunOptions& options)
+{
+  cd.SetTolerances(options.tolerances);
+  cd.SetMaterial(options.material);
   cd.Init();
 
-  for (double t = 0; t < total_time; t += dt)
+  const double total_time = options.total_time;
+  long steps = 0;
+  if (options.schedule)
   {
-    cd.Step(dt);
+    // Every breakpoint ends a step, see common/schedule.hpp
+    const Schedule& schedule = *options.schedule;
+    std::vector<double> values;
+    double dt = options.dt;
+    bool at_breakpoint = true;
+    for (double t = 0; t < total_time; ++steps)
+    {
+      if (at_breakpoint || schedule.Ramping(t))
+      {
+        schedule.Evaluate(t, values);
+        cd.SetTemperature(values[schedule.Find("temperature_kelvin")]);
+        cd.SetDoseRate(values[schedule.Find("dose_rate")]);
+      }
+
+      const double event = std::min(total_time, schedule.NextBreakpoint(t));
+      if (options.adaptive) t = cd.AdaptiveStep(t, event, dt);
+      else
+      {
+        const double h = std::min(dt, event - t);
+        cd.Step(h);
+        t += h;
+      }
+
+      at_breakpoint = t >= event;
+      if (at_breakpoint) t = event;
+    }
+  }
+  else if (options.adaptive)
+  {
+    double dt = options.dt;
+    for (double t = 0; t < total_time; ++steps)
+    {
+      t = cd.AdaptiveStep(t, total_time, dt);
+    }
+  }
+  else
+  {
+    // t is recomputed from the step count so rounding error does not accumulate, and the
+    // last step is shortened to land exactly on total_time
+    const double dt = options.dt;
+    for (double t = 0; t < total_time; t = ++steps * dt)
+    {
+      cd.Step(std::min(dt, total_time - t));
+    }
+  }
+  std::cerr << steps << " steps" << std::endl;
+}
+
+// Final concentrations and their derivatives as CSV: one row of concentrations, then one row of
+// dC/dθ per parameter θ the model depends on (see PARAMETER_USED)
+void printSensitivities(SensitivityState& cd)
+{
+  MMD_TRACE_SCOPE("output");
+  std::string unused;
+  for (int p = 0; p < SensitivityState::NUM_PARAMETERS; ++p)
+  {
+    if (!SensitivityState::PARAMETER_USED[p]) unused += std::string(unused.empty() ? "" : ", ") + SensitivityState::PARAMETER_NAMES[p];
+  }
+  if (!unused.empty()) std::cerr << "No rows for " << unused << ", the model doesn't use them yet" << std::endl;
+
+  std::cout << "value";
+  for (int n = 1; n <= cd.num_cluster_sizes; ++n) std::cout << ", C_i" << n;
+  for (int n = 1; n <= cd.num_cluster_sizes; ++n) std::cout << ", C_v" << n;
+  std::cout << "\nC";
+  for (int n = 1; n <= cd.num_cluster_sizes; ++n) std::cout << ", " << cd.C_i(n).value;
+  for (int n = 1; n <= cd.num_cluster_sizes; ++n) std::cout << ", " << cd.C_v(n).value;
+  std::cout << "\n";
+
+  for (int p = 0; p < SensitivityState::NUM_PARAMETERS; ++p)
+  {
+    if (!SensitivityState::PARAMETER_USED[p]) continue;
+    std::cout << "d/d" << SensitivityState::PARAMETER_NAMES[p];
+    for (int n = 1; n <= cd.num_cluster_sizes; ++n) std::cout << ", " << cd.C_i(n).gradient[p];
+    for (int n = 1; n <= cd.num_cluster_sizes; ++n) std::cout << ", " << cd.C_v(n).gradient[p];
+    std::cout << "\n";
   }
 }
 
 int main(int argc, char** argv)
 {
-  if (argc < 3) 
+  RunOptions options;
+  std::string schedule_file;
+  std::string trace_file; // For builds with TRACE=1, see common/trace.hpp
+
+  std::vector<char*> args;
+  for (int a = 1; a < argc; ++a)
   {
-    std::cout << "Too few args. Usage: test [dt] [steps]" << std::endl;
+    const bool has_value = a + 1 < argc;
+    if (std::strcmp(argv[a], "--cluster-sizes") == 0 && has_value)
+    {
+      options.num_cluster_sizes = atoi(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--schedule") == 0 && has_value)
+    {
+      schedule_file = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--trace") == 0 && has_value)
+    {
+      trace_file = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--material") == 0 && has_value)
+    {
+      try {
+        options.material = *Material::Get(argv[++a]);
+      }
+      catch (const std::exception& e) {
+        std::cout << "Bad material: " << e.what() << std::endl;
+        return 1;
+      }
+      if (const char* missing = options.material.Missing(CDState::MATERIAL_FIELDS))
+      {
+        std::cout << "The material has no " << missing << std::endl;
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[a], "--sensitivities") == 0)
+    {
+      options.sensitivities = true;
+    }
+    else if (std::strcmp(argv[a], "--grid") == 0 && has_value)
+    {
+      // nx for a 1D grid, or nx,ny,nz
+      options.spatial = true;
+      const int axes = std::sscanf(argv[++a], "%d,%d,%d", &options.grid.nx, &options.grid.ny, &options.grid.nz);
+      if (axes != 1 && axes != 3)
+      {
+        std::cout << "--grid takes nx or nx,ny,nz" << std::endl;
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[a], "--spacing") == 0 && has_value)
+    {
+      options.grid.spacing = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--boundary") == 0 && has_value)
+    {
+      const std::string boundary = argv[++a];
+      if (boundary == "sink") options.grid.boundary = Boundary::Sink;
+      else if (boundary == "reflect") options.grid.boundary = Boundary::Reflect;
+      else
+      {
+        std::cout << "Unknown boundary " << boundary << ", expected sink or reflect" << std::endl;
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[a], "--domains") == 0 && has_value)
+    {
+      options.grid.domains = atoi(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--profile") == 0 && has_value)
+    {
+      options.profile_file = argv[++a];
+    }
+    else if (std::strcmp(argv[a], "--adaptive") == 0)
+    {
+      options.adaptive = true;
+    }
+    else if (std::strcmp(argv[a], "--precision") == 0 && has_value)
+    {
+      const std::string precision = argv[++a];
+      if (precision != DoublePrecision::NAME && precision != CompensatedPrecision::NAME)
+      {
+        std::cout << "Unknown precision " << precision << ". Options: double, compensated" << std::endl;
+        return 1;
+      }
+      options.compensated = precision == CompensatedPrecision::NAME;
+    }
+    else if (std::strcmp(argv[a], "--rtol") == 0 && has_value)
+    {
+      options.tolerances.rtol = atof(argv[++a]);
+    }
+    else if (std::strcmp(argv[a], "--atol") == 0 && has_value)
+    {
+      options.tolerances.atol = atof(argv[++a]);
+    }
+    else
+    {
+      args.push_back(argv[a]);
+    }
+  }
+
+  if (args.size() < 2) 
+  {
+    std::cout << "Too few args. Usage: cd [--cluster-sizes n] [--adaptive] [--rtol r] [--atol a] [--precision double|compensated] [--material name|file] [--schedule file] [--sensitivities] [--grid nx[,ny,nz] [--spacing dx] [--boundary sink|reflect] [--domains n] [--profile file]] [--trace file] [dt] [total_time]" << std::endl;
+    return 1;
+  }
+
+  if (options.num_cluster_sizes < 1)
+  {
+    std::cout << "--cluster-sizes must be at least 1" << std::endl;
+    return 1;
+  }
+
+  if (!schedule_file.empty())
+  {
+    try {
+      options.schedule = std::make_shared<const Schedule>(Schedule::Load(schedule_file, {{"temperature_kelvin", CDState::DEFAULT_T}, {"dose_rate", 1.0}}));
+    }
+    catch (const std::exception& e) {
+      std::cout << "Bad schedule " << schedule_file << ": " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  if (options.spatial && options.sensitivities)
+  {
+    std::cout << "--sensitivities is not supported with --grid" << std::endl;
+    return 1;
+  }
+
+  if (options.compensated && (options.adaptive || options.sensitivities || options.spatial))
+  {
+    std::cout << "--precision compensated is for fixed steps of a single cell, without --adaptive, --sensitivities or --grid" << std::endl;
     return 1;
   }
 
-  double dt = atof(argv[1]);
-  double total_time = atof(argv[2]);
+  if (!trace_file.empty() && !TRACE_ENABLED) std::cerr << "Built without TRACE=1, --trace is ignored" << std::endl;
+
+  options.dt = atof(args[0]);
+  options.total_time = atof(args[1]);
 
-  runCD(dt, total_time);
+  // Adaptive steps throw if their step size underflows, and the grid on bad options
+  try {
+    if (options.spatial)
+    {
+      SpatialCD cd(options.num_cluster_sizes, options.grid);
+      runCD(cd, options);
+      cd.WriteProfile(options.profile_file);
+    }
+    else if (options.sensitivities)
+    {
+      SensitivityState cd(options.num_cluster_sizes);
+      runCD(cd, options);
+      printSensitivities(cd);
+    }
+    else
+    {
+      CDState cd(options.num_cluster_sizes);
+      cd.compensated = options.compensated;
+      runCD(cd, options);
+    }
+  }
+  catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+  MMD_TRACE_FINISH(trace_file);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "spatial.hpp"
+#include "../../common/columns.hpp"
+#include "../../common/trace.hpp"
+
+SpatialCD::SpatialCD(int num_cluster_sizes, const SpatialOptions& options)
+  : num_cluster_sizes(num_cluster_sizes), options(options), plane_size(options.ny * options.nz)
+{
+  if (options.nx < 1 || options.ny < 1 || options.nz < 1) throw std::invalid_argument("Every grid axis needs at least one cell");
+  if (!(options.spacing > 0)) throw std::invalid_argument("Cell spacing must be positive");
+
+  dimensions = (options.nx > 1) + (options.ny > 1) + (options.nz > 1);
+
+  const int num_domains = std::clamp<int>(options.domains, 1, options.nx);
+  for (int d = 0; d < num_domains; ++d)
+  {
+    auto domain = std::make_unique<Domain>(num_cluster_sizes);
+    domain->index = d;
+    domain->first_plane = static_cast<long>(options.nx) * d / num_domains;
+    domain->num_planes = static_cast<long>(options.nx) * (d + 1) / num_domains - domain->first_plane;
+
+    const size_t num_cells = static_cast<size_t>(domain->num_planes) * plane_size;
+    const size_t field_size = static_cast<size_t>(domain->num_planes + 2) * plane_size;
+    domain->reaction_dt.assign(num_cells, 0.0);
+    domain->controller_memory.assign(num_cells, StepController().Memory());
+    for (int b = 0; b < 2; ++b)
+    {
+      domain->c_i[b].assign(field_size, 0.0);
+      domain->c_v[b].assign(field_size, 0.0);
+    }
+    domains.push_back(std::move(domain));
+  }
+
+  if (num_domains > 1) pool = std::make_unique<ThreadPool>(num_domains);
+}
+
+void SpatialCD::SetTolerances(const Tolerances& tol)
+{
+  for (auto& domain : domains) domain->kernel.SetTolerances(tol);
+}
+
+void SpatialCD::SetMaterial(const Material& material)
+{
+  for (auto& domain : domains) domain->kernel.SetMaterial(material);
+}
+
+void SpatialCD::Init()
+{
+  for (auto& domain : domains)
+  {
+    domain->kernel.Init();
+
+    CDState::State initial(2 * num_cluster_sizes + 1);
+    domain->kernel.GetState(initial);
+    domain->cells.assign(static_cast<size_t>(domain->num_planes) * plane_size, initial);
+  }
+}
+
+void SpatialCD::SetTemperature(double T)
+{
+  for (auto& domain : domains) domain->kernel.SetTemperature(T);
+}
+
+void SpatialCD::SetDoseRate(double dose_rate)
+{
+  for (auto& domain : domains) domain->kernel.SetDoseRate(dose_rate);
+}
+
+void SpatialCD::Step(double dt)
+{
+  SplitStep(dt, false);
+}
+
+double SpatialCD::AdaptiveStep(double t, double t_end, double& dt)
+{
+  const bool last = t + dt >= t_end;
+  SplitStep(last ? t_end - t : dt, true);
+  return last ? t_end : t + dt;
+}
+
+const CDState::State& SpatialCD::Cell(int x, int y, int z) const
+{
+  for (const auto& domain : domains)
+  {
+    const int plane = x - domain->first_plane;
+    if (plane >= 0 && plane < domain->num_planes) return domain->cells[(static_cast<size_t>(plane) * options.ny + y) * options.nz + z];
+  }
+  throw std::out_of_range("No cell at x = " + std::to_string(x));
+}
+
+void SpatialCD::WriteProfile(const std::string& path) const
+{
+  MMD_TRACE_SCOPE("output");
+  std::vector<std::string> names = {"x", "y", "z"};
+  for (int n = 1; n <= num_cluster_sizes; ++n) names.push_back("C_i" + std::to_string(n));
+  for (int n = 1; n <= num_cluster_sizes; ++n) names.push_back("C_v" + std::to_string(n));
+  names.push_back("rho");
+
+  std::unique_ptr<ColumnWriter> writer = OpenColumnWriter(path, names);
+  std::vector<double> row(names.size());
+  for (int x = 0; x < options.nx; ++x) {
+    for (int y = 0; y < options.ny; ++y) {
+      for (int z = 0; z < options.nz; ++z)
+      {
+        row[0] = (x + 0.5) * options.spacing;
+        row[1] = (y + 0.5) * options.spacing;
+        row[2] = (z + 0.5) * options.spacing;
+        const CDState::State& cell = Cell(x, y, z);
+        std::copy(cell.begin(), cell.end(), row.begin() + 3);
+        writer->Write(row.data());
+      }
+    }
+  }
+  writer->Flush();
+}
+
+//-----------------------------------------------------------------
+// Split step
+//-----------------------------------------------------------------
+
+void SpatialCD::SplitStep(double h, bool adaptive)
+{
+  ForEachDomain(&SpatialCD::Gather, 0.0);
+  DiffusionStep(h / 2);
+  ForEachDomain(adaptive ? &SpatialCD::ReactAdaptive : &SpatialCD::React, h);
+  DiffusionStep(h / 2);
+  ForEachDomain(&SpatialCD::Scatter, 0.0);
+}
+
+void SpatialCD::DiffusionStep(double h)
+{
+  if (dimensions == 0) return;
+  MMD_TRACE_SCOPE("diffusion");
+
+  // Explicit substeps, each within the stability limit D h / dx^2 <= 1 / (2 * dimensions)
+  const CDState& kernel = domains.front()->kernel;
+  const double D_max = std::max(kernel.InterstitialDiffusivity(), kernel.VacancyDiffusivity());
+  const double limit = options.spacing * options.spacing / (2 * dimensions * D_max);
+  const long substeps = std::max(1.0, std::ceil(h / limit));
+
+  MMD_TRACE_COUNT("diffusion substeps", substeps);
+  for (long s = 0; s < substeps; ++s)
+  {
+    ForEachDomain(&SpatialCD::Diffuse, h / substeps);
+    current ^= 1;
+  }
+}
+
+void SpatialCD::ForEachDomain(void (SpatialCD::*phase)(Domain&, double), double arg)
+{
+  if (!pool)
+  {
+    (this->*phase)(*domains.front(), arg);
+    return;
+  }
+
+  // Wait is the barrier between phases, no domain starts the next one before all finish this one
+  for (auto& domain : domains)
+  {
+    Domain* d = domain.get();
+    pool->Submit([this, phase, d, arg] { (this->*phase)(*d, arg); });
+  }
+  pool->Wait();
+}
+
+//-----------------------------------------------------------------
+// Phases, each run by every domain at once on its own slab
+//-----------------------------------------------------------------
+
+void SpatialCD::Gather(Domain& domain, double)
+{
+  for (size_t c = 0; c < domain.cells.size(); ++c)
+  {
+    domain.c_i[current][plane_size + c] = domain.cells[c][0];
+    domain.c_v[current][plane_size + c] = domain.cells[c][num_cluster_sizes];
+  }
+}
+
+void SpatialCD::Scatter(Domain& domain, double)
+{
+  for (size_t c = 0; c < domain.cells.size(); ++c)
+  {
+    domain.cells[c][0] = domain.c_i[current][plane_size + c];
+    domain.cells[c][num_cluster_sizes] = domain.c_v[current][plane_size + c];
+  }
+}
+
+void SpatialCD::Exchange(Domain& domain)
+{
+  // Only reads the neighbours' owned planes of the current buffer, which nothing writes during a
+  // substep
+  const size_t index = domain.index;
+  const size_t top = static_cast<size_t>(domain.num_planes + 1) * plane_size;
+
+  for (auto field : {&Domain::c_i, &Domain::c_v})
+  {
+    std::vector<double>& c = (domain.*field)[current];
+
+    if (index > 0)
+    {
+      const Domain& below = *domains[index - 1];
+      std::copy_n((below.*field)[current].begin() + static_cast<size_t>(below.num_planes) * plane_size, plane_size, c.begin());
+    }
+    else if (options.boundary == Boundary::Sink) std::fill_n(c.begin(), plane_size, 0.0);
+    else std::copy_n(c.begin() + plane_size, plane_size, c.begin());
+
+    if (index + 1 < domains.size())
+    {
+      const Domain& above = *domains[index + 1];
+      std::copy_n((above.*field)[current].begin() + plane_size, plane_size, c.begin() + top);
+    }
+    else if (options.boundary == Boundary::Sink) std::fill_n(c.begin() + top, plane_size, 0.0);
+    else std::copy_n(c.begin() + top - plane_size, plane_size, c.begin() + top);
+  }
+}
+
+void SpatialCD::Diffuse(Domain& domain, double h)
+{
+  Exchange(domain);
+
+  const int ny = options.ny, nz = options.nz;
+  const bool sink = options.boundary == Boundary::Sink;
+  const double dx2 = options.spacing * options.spacing;
+
+  auto diffuse = [&](const std::vector<double>& c, std::vector<double>& next, double D)
+  {
+    const double r = D * h / dx2;
+    for (int p = 1; p <= domain.num_planes; ++p) {
+      for (int y = 0; y < ny; ++y) {
+        for (int z = 0; z < nz; ++z)
+        {
+          const size_t i = (static_cast<size_t>(p) * ny + y) * nz + z;
+          const double here = c[i];
+          const double outside = sink ? 0.0 : here; // Neighbour across a y or z face of the grid
+
+          double laplacian = 0.0;
+          if (options.nx > 1) laplacian += c[i - plane_size] + c[i + plane_size] - 2 * here;
+          if (ny > 1) laplacian += (y > 0 ? c[i - nz] : outside) + (y + 1 < ny ? c[i + nz] : outside) - 2 * here;
+          if (nz > 1) laplacian += (z > 0 ? c[i - 1] : outside) + (z + 1 < nz ? c[i + 1] : outside) - 2 * here;
+
+          next[i] = here + r * laplacian;
+        }
+      }
+    }
+  };
+
+  diffuse(domain.c_i[current], domain.c_i[current ^ 1], domain.kernel.InterstitialDiffusivity());
+  diffuse(domain.c_v[current], domain.c_v[current ^ 1], domain.kernel.VacancyDiffusivity());
+}
+
+void SpatialCD::React(Domain& domain, double h)
+{
+  Scatter(domain, 0.0);
+  for (CDState::State& cell : domain.cells)
+  {
+    domain.kernel.SetState(cell);
+    domain.kernel.Step(h);
+    domain.kernel.GetState(cell);
+  }
+  Gather(domain, 0.0);
+}
+
+void SpatialCD::ReactAdaptive(Domain& domain, double h)
+{
+  Scatter(domain, 0.0);
+  for (size_t c = 0; c < domain.cells.size(); ++c)
+  {
+    // Each cell keeps its own step size and controller memory, as if it were integrated alone
+    double& dt = domain.reaction_dt[c];
+    if (dt <= 0) dt = h;
+
+    domain.kernel.SetState(domain.cells[c]);
+    domain.kernel.SetControllerMemory(domain.controller_memory[c]);
+    for (double t = 0; t < h;) t = domain.kernel.AdaptiveStep(t, h, dt);
+    domain.kernel.GetState(domain.cells[c]);
+    domain.controller_memory[c] = domain.kernel.ControllerMemory();
+  }
+  Gather(domain, 0.0);
+}
\ No newline at end of file
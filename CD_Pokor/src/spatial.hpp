@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../common/thread_pool.hpp"
+#include "cd.hpp"
+
+// Spatially resolved cluster dynamics on a 1D or 3D grid of cells, for defect profiles near
+// surfaces and grain boundaries. Every cell holds its own species vector (a CDState::State) and
+// the mobile monomers, C_i1 and C_v1, diffuse between neighbouring cells.
+//
+// Each step is Strang split: half a step of diffusion, a full step of the reactions in every cell
+// on its own, then the second half of the diffusion. The grid is cut into slabs along x, one
+// domain per thread, each with a ghost plane on either side that is refreshed from its
+// neighbours (the halo exchange) at the start of every explicit diffusion substep. Results don't
+// depend on the number of domains.
+
+enum class Boundary
+{
+  Sink, // Perfect sink such as a free surface or grain boundary, the monomer concentration is held at 0 outside
+  Reflect // No flux through the boundary
+};
+
+struct SpatialOptions
+{
+  int nx = 1, ny = 1, nz = 1; // Cells along each axis, a 1D grid has ny = nz = 1
+  double spacing = 1e-4; // Cell width in cm
+  Boundary boundary = Boundary::Sink; // On every face of the grid
+  unsigned domains = std::thread::hardware_concurrency(); // At most nx are used
+};
+
+class SpatialCD
+{
+public:
+  SpatialCD(int num_cluster_sizes, const SpatialOptions& options);
+
+  const int num_cluster_sizes;
+
+  void SetTolerances(const Tolerances& tol);
+  void SetMaterial(const Material& material);
+  void Init();
+
+  // The same conditions everywhere, as for CDState
+  void SetTemperature(double T);
+  void SetDoseRate(double dose_rate);
+
+  void Step(double dt); // One split step, with each cell's reactions stepped by forward Euler
+
+  // One split step from t of at most dt, never past t_end, with each cell's reactions integrated
+  // to tolerance by its own error controlled Dormand-Prince steps. dt is the splitting step and is
+  // left as it is. Returns the time reached.
+  double AdaptiveStep(double t, double t_end, double& dt);
+
+  size_t NumCells() const { return static_cast<size_t>(options.nx) * options.ny * options.nz; }
+  const CDState::State& Cell(int x, int y, int z) const; // Interstitials, vacancies, then rho as for CDState
+
+  // Writes one row per cell: its centre x, y and z in cm, then its concentrations. CSV, or binary
+  // columns for names ending in .bin (common/columns.hpp).
+  void WriteProfile(const std::string& path) const;
+
+private:
+  // A slab of whole x planes and the thread state that works on it
+  struct Domain
+  {
+    size_t index = 0; // In domains
+    int first_plane = 0, num_planes = 0;
+
+    CDState kernel; // Reaction step for one cell at a time, loaded with each cell's state in turn
+    std::vector<CDState::State> cells; // By (plane * ny + y) * nz + z
+
+    // Per cell Dormand-Prince step and controller memory, for AdaptiveStep
+    std::vector<double> reaction_dt;
+    std::vector<double> controller_memory;
+
+    // Monomer fields with a ghost plane on either side, planes 0 and num_planes + 1. Diffusion
+    // substeps alternate between the two buffers, see current.
+    std::vector<double> c_i[2], c_v[2];
+
+    explicit Domain(int num_cluster_sizes) : kernel(num_cluster_sizes) {}
+  };
+
+  SpatialOptions options;
+  int plane_size; // ny * nz
+  int dimensions; // Axes more than one cell long, the others aren't diffused along
+  int current = 0; // Buffer of the fields holding the latest values
+  std::vector<std::unique_ptr<Domain>> domains;
+  std::unique_ptr<ThreadPool> pool;
+
+  void ForEachDomain(void (SpatialCD::*phase)(Domain&, double), double arg);
+
+  void Gather(Domain& domain, double); // Cells to monomer fields
+  void Scatter(Domain& domain, double); // Monomer fields to cells
+  void Exchange(Domain& domain); // Fills the ghost planes of the current buffer
+  void Diffuse(Domain& domain, double h); // One explicit substep of length h, into the other buffer
+  void React(Domain& domain, double h);
+  void ReactAdaptive(Domain& domain, double h);
+
+  void DiffusionStep(double h);
+  void SplitStep(double h, bool adaptive);
+};
\ No newline at end of file
@@ -1,5 +1,9 @@
 #!/bin/bash
 
-g++ mfrt.cpp $(root-config --glibs --cflags --libs) -o mfrt
+# Headless model
+g++ -std=c++17 -O2 -pthread mfrt.cpp -o mfrt
+
+# ROOT viewer for its output
+g++ -std=c++17 plot.cpp $(root-config --glibs --cflags --libs) -o mfrt_plot
 
 exit 0
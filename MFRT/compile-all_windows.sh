@@ -1,12 +1,15 @@
 #!/bin/bash
 
-# Use GNU to get mfrt.o
-g++ -Wall -I<path to root include, example: /../root/include> -c mfrt.cpp
+# Headless model, needs no ROOT
+g++ -std=c++17 -O2 -pthread mfrt.cpp -o mfrt
 
-# Use mfrt.o to link libraries and compile into exec format
-g++ -O2 -m64 mfrt.o -L</../root/lib> -lCore -lRIO -lNet -lHist -lGraf -lGraf3d -lGpad -lTree -lRint -lPostscript -lMatrix -lPhysics -lMathCore -lThread -pthread -lm -ldl -rdynamic -o mfrtROOT -L</../root/lib> -Wl,-R</../root/lib>
+# Use GNU to get plot.o
+g++ -Wall -std=c++17 -I<path to root include, example: /../root/include> -c plot.cpp
+
+# Use plot.o to link libraries and compile the viewer into exec format
+g++ -O2 -m64 plot.o -L</../root/lib> -lCore -lRIO -lNet -lHist -lGraf -lGraf3d -lGpad -lTree -lRint -lPostscript -lMatrix -lPhysics -lMathCore -lThread -pthread -lm -ldl -rdynamic -o mfrt_plot -L</../root/lib> -Wl,-R</../root/lib>
 
 # Clean up
-rm -f ./mfrt.o
+rm -f ./plot.o
 
 exit 0
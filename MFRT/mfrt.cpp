@@ -1,86 +1,216 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <numeric>
 #include <array>
-#include "TGraph.h"
-#include "TCanvas.h"
-#include "TGButton.h"
-#include "TGClient.h"
-#include "TMultiGraph.h"
-#include "TApplication.h"
-#include "TRootCanvas.h"
-#include "TF1.h"
-
-#define _USE_MATH_DEFINES
-#include<cmath>
+#include <mutex>
 
 #include "../vendor/nlohmann/json.hpp"
+#include "../common/adaptive.hpp"
+#include "../common/columns.hpp"
+#include "../common/sweep.hpp"
+#include "../common/thread_pool.hpp"
+#include "../common/trace.hpp"
+#include "model.hpp"
 
-  // Physical parameters
-
-  double C_i = 0.0; // Concentration of interstitials
-  double C_v = 0.0; // Concentration of vacancies
- 
-  // using Material parameters from SA304
-  double D_0i = 0.001; //cm2/s
-  double D_0v = 0.6; //cm2/s
-  double E_mv = 1.35; //eV
-  double E_mi = 0.45; //eV
-  double k = 8.6173 * std::pow(10,-5); //eV K^-1 k is the Boltzmann constant
-  double r_iv = 7 * std::pow(10,-8); //should be 7nm but the simulation is in cm
-
-  // We can assume r_vs = r_is = 10^-4 cm according to 10-19-23 slides.
-  double r_vs = std::pow(10,-4);
-  double r_is = r_vs;
-
-  // Run the simulation
-  void run_model(double sample_interval, double dt, double endtime, double Temp, int K_0_exp, int C_s_exp, TGraph* g1, TGraph* g2) 
+MFRTParameters read_parameters(const nlohmann::json& config)
+{
+  MFRTParameters p;
+  p.total_time = config.at("total_time_seconds");
+  p.dt = config.at("dt_seconds");
+  p.temperature = config.at("temperature_kelvin");
+  p.K_0_exp = config.at("K_0_exp");
+  p.C_s_exp = config.at("C_s_exp");
+
+  p.sample_interval = config.at("sample_interval");
+
+  // Optional error controlled stepping, dt_seconds is then only the first step tried
+  p.adaptive = config.value("adaptive", false);
+  p.tolerances.rtol = config.value("rtol", p.tolerances.rtol);
+  p.tolerances.atol = config.value("atol", p.tolerances.atol);
+
+  p.steady_state = config.value("steady_state", false);
+
+  // How fixed steps add their updates, see common/precision.hpp
+  const std::string precision = config.value("precision", DoublePrecision::NAME);
+  if (precision != DoublePrecision::NAME && precision != CompensatedPrecision::NAME) throw std::runtime_error("Unknown precision " + precision + ". Options: double, compensated");
+  p.compensated = precision == CompensatedPrecision::NAME;
+  if (p.compensated && (p.adaptive || config.value("sensitivities", false))) throw std::runtime_error("Compensated precision is for fixed steps without sensitivities");
+
+  // A built in material or a material file, see common/material.hpp
+  if (config.contains("material"))
+  {
+    p.material = *Material::Get(config["material"].get<std::string>());
+    if (const char* missing = p.material.Missing(MFRTModel::MATERIAL_FIELDS)) throw std::runtime_error(std::string("The material has no ") + missing);
+  }
+  return p;
+}
+
+void report(const MFRTParameters& parameters, const MFRTModel::Result& result, const std::string& prefix = "")
+{
+  switch (result.status)
+  {
+    case MFRTModel::Status::Finished:
+      if (parameters.steady_state) std::cerr << prefix << "Found the steady state" << std::endl;
+      else std::cerr << prefix << "Finished simulation in " << result.steps << " steps (" << result.rejected << " rejected)" << std::endl;
+      break;
+    case MFRTModel::Status::LimitReached:
+      std::cerr << prefix << "Limit reached stopping model.." << std::endl;
+      break;
+    case MFRTModel::Status::StepUnderflow:
+      std::cerr << prefix << "Step size underflow at t = " << result.t << ", stopping model.." << std::endl;
+      break;
+  }
+}
+
+// Columns of one sample: t, C_i, C_v, and with sensitivities dC_i/dθ then dC_v/dθ for every
+// material parameter θ
+std::vector<std::string> sample_columns(bool sensitivities)
+{
+  std::vector<std::string> columns = {"t", "C_i", "C_v"};
+  if (sensitivities) {
+    for (const char* C : {"C_i", "C_v"}) {
+      for (const char* parameter : MFRTModel::PARAMETER_NAMES) columns.push_back(std::string("d") + C + "/d" + parameter);
+    }
+  }
+  return columns;
+}
+
+// Model.Run, or for a steady state run a single sample at t = inf
+template <typename Model, typename OnSample>
+MFRTModel::Result run_model(Model& model, const MFRTParameters& parameters, OnSample&& on_sample)
+{
+  if (!parameters.steady_state) return model.Run(parameters, on_sample);
+
+  MFRTModel::Result result{model.SteadyState(parameters), HUGE_VAL, 0, 0};
+  if (result.status == MFRTModel::Status::Finished) on_sample(result.t, model.C_i, model.C_v);
+  return result;
+}
+
+// Runs one case, passing every sample to on_sample as the values of sample_columns. The
+// sensitivities come from the same single run, carried through it in dual numbers.
+template <typename OnSample>
+MFRTModel::Result run_case(const MFRTParameters& parameters, bool sensitivities, OnSample&& on_sample)
+{
+  if (!sensitivities)
   {
-		// running variable init
-		// Calculating the D_i and D_v.
-		double D_i = D_0i * std::exp(-(E_mi/(k*Temp))); // Interstitial diffusion coefficient
-		double D_v = D_0v * std::exp(-(E_mv/(k*Temp))); // Vacancy diffusion coefficient		
-		
-		double K_0 = std::pow(10,K_0_exp); //defect production rate
-		double C_s = std::pow(10,C_s_exp); //sink concentration
-
-		double K_iv = 4.0 * M_PI * r_iv * (D_i + D_v); // vancancy-interstitial recombination rate coeff
-		double K_is = 4.0 * M_PI * r_is * D_i; // interstitial-sink reaction rate coeff.
-		double K_vs = 4.0 * M_PI * r_vs * D_v; // vancancy-sink reaction rate coeff.
-
-    double sample_counter = sample_interval;
-    for (double t = 0.0; t < endtime; t += dt) 
+    MFRTModel model;
+    model.SetMaterial(parameters.material);
+    return run_model(model, parameters, [&](double t, double C_i, double C_v) {
+      const double sample[] = {t, C_i, C_v};
+      on_sample(sample);
+    });
+  }
+
+  constexpr int N = MFRTModel::NUM_PARAMETERS;
+  double sample[3 + 2 * N];
+  MFRTSensitivityModel model;
+  model.SetMaterial(parameters.material);
+  return run_model(model, parameters, [&](double t, const MFRTDual& C_i, const MFRTDual& C_v) {
+    sample[0] = t;
+    sample[1] = C_i.value;
+    sample[2] = C_v.value;
+    std::copy(C_i.gradient.begin(), C_i.gradient.end(), sample + 3);
+    std::copy(C_v.gradient.begin(), C_v.gradient.end(), sample + 3 + N);
+    on_sample(sample);
+  });
+}
+
+// Runs every case of the config's sweep on a thread pool and writes all their samples to one
+// file, labelled by case number and swept values
+int run_sweep(const nlohmann::json& config)
+{
+  std::vector<nlohmann::json> cases;
+  std::vector<std::string> keys;
+  try {
+    cases = ExpandSweep(config);
+    keys = SweepKeys(config);
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  const std::string output_name = config.value("sweep_output", "sweep.csv");
+  const bool sensitivities = config.value("sensitivities", false);
+
+  std::vector<std::string> columns = {"case"};
+  columns.insert(columns.end(), keys.begin(), keys.end());
+  const size_t first_sample_column = columns.size();
+  const std::vector<std::string> samples = sample_columns(sensitivities);
+  columns.insert(columns.end(), samples.begin(), samples.end());
+
+  for (const nlohmann::json& c : cases) {
+    for (const std::string& key : keys)
     {
-      double dC_i = (K_0 - K_iv * C_i * C_v - K_is * C_i * C_s) * dt;
-      double dC_v = (K_0 - K_iv * C_i * C_v - K_vs * C_v * C_s) * dt;
-
-			if (std::isinf(dC_i) || std::isinf(dC_v) || std::isnan(dC_i) || std::isnan(dC_v))
-			{
-				std::cerr << "Limit reached stopping model.." << std::endl;
-				return; 
-			}
-
-      C_i += dC_i;
-      C_v += dC_v;
-
-      sample_counter += dt;
-      if (sample_counter >= sample_interval)
-      {
-				// double sink_diff = K_is * C_i * C_s - K_vs * C_v * C_s;
-        sample_counter = 0.0;
-				g1->AddPoint(t, C_i);
-				g2->AddPoint(t, C_v);
-      }
+      if (c[key].is_number() || c[key].is_boolean()) continue;
+      std::cerr << "Swept value " << c[key] << " of " << key << " is not a number" << std::endl;
+      return 1;
     }
+  }
+
+  // Read up front, so a bad material stops the sweep before it starts
+  std::vector<MFRTParameters> parameters;
+  try {
+    for (const nlohmann::json& c : cases) parameters.push_back(read_parameters(c));
+  }
+  catch (const std::exception& e) {
+    std::cerr << "Case " << parameters.size() << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<ColumnWriter> output = OpenColumnWriter(output_name, columns);
+
+  std::mutex output_mutex;
+  auto run_one = [&](size_t n) {
+    std::vector<double> row = {double(n)};
+    // Booleans are written as 0 or 1, the output columns are all numbers
+    for (const std::string& key : keys)
+    {
+      const nlohmann::json& value = cases[n][key];
+      row.push_back(value.is_boolean() ? double(value.get<bool>()) : value.get<double>());
+    }
+    row.resize(columns.size());
 
-    std::cerr << "Finished simulation" << std::endl;
+    // Samples are streamed as they come, rows of different cases interleave but carry the case
+    MFRTModel::Result result = run_case(parameters[n], sensitivities, [&](const double* sample) {
+      std::copy(sample, sample + samples.size(), row.begin() + first_sample_column);
+      std::lock_guard<std::mutex> lock(output_mutex);
+      MMD_TRACE_SCOPE("output");
+      output->Write(row.data());
+    });
+
+    std::lock_guard<std::mutex> lock(output_mutex);
+    report(parameters[n], result, "Case " + std::to_string(n) + ": ");
+  };
+
+  ThreadPool pool(config.value("threads", std::thread::hardware_concurrency()));
+  for (size_t n = 0; n < cases.size(); ++n)
+  {
+    pool.Submit([&, n] {
+      try {
+        run_one(n);
+      }
+      catch (const std::exception& e) {
+        // Name the case, the pool only rethrows the first failure
+        throw std::runtime_error("Case " + std::to_string(n) + ": " + e.what());
+      }
+    });
   }
+  try {
+    pool.Wait();
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  output->Flush();
+
+  std::cerr << "Wrote " << cases.size() << " cases to " << output_name << std::endl;
+  return 0;
+}
 
 int main(int argc, char** argv)
 {
-  // Define the application start point and the name <- args of main.
-  TApplication app("app", &argc, argv);
-  
   // Simulation ..
   const std::string config_file_name = argc < 2 ? "config.json" : argv[1];
 
@@ -91,54 +221,48 @@ int main(int argc, char** argv)
     return 1;
   }
 
-  nlohmann::json config = nlohmann::json::parse(config_file);
-  double time = config["total_time_seconds"];
-  double dt = config["dt_seconds"];
-  double Temp = config["temperature_kelvin"];
-  int K_0_exp = config["K_0_exp"];
-  int C_s_exp = config["C_s_exp"];
-
-  double sample_interval = config["sample_interval"];
-  // Define the 'canvas' aka main window
-  TCanvas* c = new TCanvas("c", "Sim", 0, 0, 800, 600);
-  
-  // c->SetLogy();
-  
-  // TGTextButton *but1 = new TGTextButton("Run Simulation","",.05,.8,.45,.88);
-  // but1->Draw();
-  
-  // Define the graphs
-  TGraph* ci_graph = new TGraph();
-  TGraph* cv_graph = new TGraph();
-
-  ci_graph->SetMarkerColor(kRed);
-  cv_graph->SetMarkerColor(kBlue);
-
-	ci_graph->SetTitle("C_i");
-	cv_graph->SetTitle("C_v");
-
-  TMultiGraph* mg = new TMultiGraph();
-  
-  run_model(sample_interval, dt, time, Temp, K_0_exp, C_s_exp, ci_graph, cv_graph);
-  
-  mg->Add(ci_graph);
-  mg->Add(cv_graph);
-
-  mg->SetTitle("MFRT");
-  mg->Draw("ALP");
-  
-  // Graph config / color
-  c->Modified(); c->Update();
-  TRootCanvas *rc = (TRootCanvas *)c->GetCanvasImp();
-
-  // Term app on window close
-  rc->Connect("CloseWindow()", "TApplication", gApplication, "Terminate()");
-  
-  // Simulation ..
+  nlohmann::json config;
+  try {
+    config = nlohmann::json::parse(config_file);
+  }
+  catch (const std::exception& e) {
+    std::cerr << config_file_name << ": " << e.what() << std::endl;
+    return 1;
+  }
 
-  // App run
-  app.Run();
+  // Chrome trace file, for builds with TRACE=1 (see common/trace.hpp)
+  const std::string trace_file = config.value("trace", "");
+  if (!trace_file.empty() && !TRACE_ENABLED) std::cerr << "Built without TRACE=1, trace is ignored" << std::endl;
 
+  if (config.contains("sweep"))
+  {
+    const int status = run_sweep(config);
+    MMD_TRACE_FINISH(trace_file);
+    return status;
+  }
 
-  return 0;
-}
+  MFRTParameters parameters;
+  try {
+    parameters = read_parameters(config);
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  const std::string output_name = config.value("output", "mfrt.csv");
+
+  const bool sensitivities = config.value("sensitivities", false);
+
+  // Samples are streamed to the file as the model runs, plot it afterwards with mfrt_plot
+  std::unique_ptr<ColumnWriter> output = OpenColumnWriter(output_name, sample_columns(sensitivities));
+
+  MFRTModel::Result result = run_case(parameters, sensitivities, [&](const double* sample) {
+    MMD_TRACE_SCOPE("output");
+    output->Write(sample);
+  });
+  output->Flush();
+  report(parameters, result);
+  MMD_TRACE_FINISH(trace_file);
+
+  return result.status == MFRTModel::Status::Finished ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,270 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <array>
+#include <type_traits>
+
+#include "../common/adaptive.hpp"
+#include "../common/dual.hpp"
+#include "../common/material.hpp"
+#include "../common/precision.hpp"
+#include "../common/trace.hpp"
+
+struct MFRTParameters
+{
+  double total_time = 0.0; // Seconds
+  double dt = 0.0; // Fixed step, or the first step to try when adaptive
+  double temperature = 0.0; // Kelvin
+  int K_0_exp = 0; // Defect production rate is 10^K_0_exp
+  int C_s_exp = 0; // Sink concentration is 10^C_s_exp
+  double sample_interval = 0.0; // Time between samples passed to Run's callback
+
+  bool adaptive = false;
+  Tolerances tolerances;
+  bool compensated = false; // Fixed steps add their updates with compensated sums, see common/precision.hpp
+
+  bool steady_state = false; // Solve for the long time limit directly instead of integrating, see SteadyState
+
+  Material material = SA304; // Must define every field in MFRTModel::MATERIAL_FIELDS
+};
+
+enum class MFRTStatus { Finished, LimitReached, StepUnderflow };
+
+struct MFRTResult
+{
+  MFRTStatus status;
+  double t; // Time reached
+  long steps;
+  long rejected;
+};
+
+// Point defect concentrations under mean field rate theory. Each instance holds its own state, so
+// any number of models can run at once.
+//
+// Real is the type of the concentrations and material parameters: double for a plain run, or a
+// Dual (common/dual.hpp) to carry their derivatives with respect to the parameters along, see
+// MFRTSensitivityModel.
+template <typename Real>
+class BasicMFRTModel
+{
+public:
+  using Status = MFRTStatus;
+  using Result = MFRTResult;
+
+  // Physical parameters
+
+  Real C_i = 0.0; // Concentration of interstitials
+  Real C_v = 0.0; // Concentration of vacancies
+
+  // using Material parameters from SA304, until SetMaterial
+  Real D_0i = SA304.D_0i; //cm2/s
+  Real D_0v = SA304.D_0v; //cm2/s
+  Real E_mv = SA304.E_mv; //eV
+  Real E_mi = SA304.E_mi; //eV
+  double k = 8.6173 * std::pow(10,-5); //eV K^-1 k is the Boltzmann constant
+  Real r_iv = SA304.r_iv; //should be 7nm but the simulation is in cm
+
+  // We can assume r_vs = r_is = 10^-4 cm according to 10-19-23 slides.
+  Real r_vs = SA304.r_vs;
+  Real r_is = SA304.r_is;
+
+  // The material parameters by index, for seeding sensitivities, and where each comes from in a Material
+  static constexpr int NUM_PARAMETERS = 7;
+  static constexpr std::array<const char*, NUM_PARAMETERS> PARAMETER_NAMES = {"D_0i", "D_0v", "E_mv", "E_mi", "r_iv", "r_vs", "r_is"};
+  static constexpr std::array<double Material::*, NUM_PARAMETERS> MATERIAL_FIELDS = {&Material::D_0i, &Material::D_0v, &Material::E_mv,
+    &Material::E_mi, &Material::r_iv, &Material::r_vs, &Material::r_is};
+  Real& Parameter(int index)
+  {
+    Real* const parameters[NUM_PARAMETERS] = {&D_0i, &D_0v, &E_mv, &E_mi, &r_iv, &r_vs, &r_is};
+    return *parameters[index];
+  }
+
+  // Sets every material parameter, which material must all define. A Dual model seeds them as its
+  // variables again.
+  void SetMaterial(const Material& material)
+  {
+    for (int p = 0; p < NUM_PARAMETERS; ++p)
+    {
+      const double value = material.*MATERIAL_FIELDS[p];
+      if constexpr (std::is_same_v<Real, double>) Parameter(p) = value;
+      else Parameter(p) = Real::Variable(value, p);
+    }
+  }
+
+  // Coefficients of the rate equations
+  //   dC_i/dt = K_0 - K_iv C_i C_v - K_is C_i C_s
+  //   dC_v/dt = K_0 - K_iv C_i C_v - K_vs C_v C_s
+  struct Rates
+  {
+    double K_0; // defect production rate
+    double C_s; // sink concentration
+    Real K_iv; // vancancy-interstitial recombination rate coeff
+    Real K_is; // interstitial-sink reaction rate coeff.
+    Real K_vs; // vancancy-sink reaction rate coeff.
+  };
+
+  Rates GetRates(const MFRTParameters& p) const
+  {
+    using std::exp;
+
+    // Calculating the D_i and D_v.
+    Real D_i = D_0i * exp(-(E_mi/(k*p.temperature))); // Interstitial diffusion coefficient
+    Real D_v = D_0v * exp(-(E_mv/(k*p.temperature))); // Vacancy diffusion coefficient
+
+    return {std::pow(10,p.K_0_exp), std::pow(10,p.C_s_exp), 4.0 * M_PI * r_iv * (D_i + D_v), 4.0 * M_PI * r_is * D_i, 4.0 * M_PI * r_vs * D_v};
+  }
+
+  // Sets C_i and C_v to the steady state, where both rates are zero, without integrating towards
+  // it. Subtracting the equations gives K_is C_i = K_vs C_v, which leaves the quadratic
+  // K_iv K_is / K_vs C_i^2 + K_is C_s C_i - K_0 = 0 for C_i. Its positive root is taken in the
+  // form that doesn't cancel when recombination is weak.
+  Status SteadyState(const MFRTParameters& p)
+  {
+    using std::sqrt;
+
+    const Rates r = GetRates(p);
+    const Real a = r.K_iv * r.K_is / r.K_vs;
+    const Real b = r.K_is * r.C_s;
+    const Real C_i_steady = 2.0 * r.K_0 / (b + sqrt(b * b + 4.0 * a * r.K_0));
+    const Real C_v_steady = r.K_is * C_i_steady / r.K_vs;
+
+    if (!std::isfinite(ValueOf(C_i_steady)) || !std::isfinite(ValueOf(C_v_steady))) return Status::LimitReached;
+    C_i = C_i_steady;
+    C_v = C_v_steady;
+    return Status::Finished;
+  }
+
+  // What stepping carries from one step to the next, which a caller running one interval at a time
+  // keeps across its Run calls so each interval continues where the last left off
+  struct Stepper
+  {
+    explicit Stepper(double dt) : dt(dt) {}
+
+    double dt; // Step to take next, adapted when adaptive
+    StepController controller{4};
+    DormandPrinceWork<std::array<Real, 2>> work;
+    std::array<Real, 2> compensation = {0.0, 0.0}; // What rounding has dropped from C in compensated steps
+  };
+
+  // Run the simulation. on_sample(t, C_i, C_v) is called every sample_interval.
+  template <typename OnSample>
+  Result Run(const MFRTParameters& p, OnSample&& on_sample)
+  {
+    Stepper stepper(p.dt);
+    return Run(p, stepper, on_sample);
+  }
+
+  // Runs from t = 0 to total_time, starting from and updating stepper
+  template <typename OnSample>
+  Result Run(const MFRTParameters& p, Stepper& stepper, OnSample&& on_sample)
+  {
+    const Rates rates = GetRates(p);
+    const double K_0 = rates.K_0;
+    const double C_s = rates.C_s;
+    const Real K_iv = rates.K_iv;
+    const Real K_is = rates.K_is;
+    const Real K_vs = rates.K_vs;
+
+    // C = {C_i, C_v}
+    auto rhs = [&](const std::array<Real, 2>& C, std::array<Real, 2>& dCdt)
+    {
+      MMD_TRACE_SCOPE("rates");
+      dCdt[0] = K_0 - K_iv * C[0] * C[1] - K_is * C[0] * C_s;
+      dCdt[1] = K_0 - K_iv * C[0] * C[1] - K_vs * C[1] * C_s;
+    };
+
+    StepController& controller = stepper.controller;
+    DormandPrinceWork<std::array<Real, 2>>& work = stepper.work;
+    std::array<Real, 2>& compensation = stepper.compensation;
+    Result result{Status::Finished, 0.0, 0, 0};
+
+    double& dt = stepper.dt;
+    double sample_counter = p.sample_interval;
+    double& t = result.t;
+    while (t < p.total_time)
+    {
+      MMD_TRACE_SCOPE("update");
+      const std::array<Real, 2> C = {C_i, C_v};
+      std::array<Real, 2> C_new;
+
+      const bool last = t + dt >= p.total_time;
+      const double h = last ? p.total_time - t : dt; // Land exactly on total_time
+
+      if (p.adaptive)
+      {
+        double error = DormandPrinceStep(rhs, C, C_new, h, p.tolerances, work);
+        double next_dt = controller.NextDt(h, error);
+        if (!StepController::Accept(error))
+        {
+          ++result.rejected;
+          MMD_TRACE_COUNT("rejected steps", 1);
+          dt = next_dt;
+          if (t + dt == t)
+          {
+            result.status = Status::StepUnderflow;
+            return result;
+          }
+          continue;
+        }
+        if (!last || next_dt < dt) dt = next_dt;
+      }
+      else
+      {
+        std::array<Real, 2> dCdt;
+        rhs(C, dCdt);
+        if constexpr (std::is_same_v<Real, double>)
+        {
+          if (p.compensated)
+          {
+            C_new = C;
+            for (int s = 0; s < 2; ++s) Accumulate<CompensatedPrecision>(C_new[s], compensation[s], dCdt[s] * h);
+          }
+          else C_new = {C[0] + dCdt[0] * h, C[1] + dCdt[1] * h};
+        }
+        else C_new = {C[0] + dCdt[0] * h, C[1] + dCdt[1] * h};
+      }
+
+      const double C_new_i = ValueOf(C_new[0]), C_new_v = ValueOf(C_new[1]);
+      if (std::isinf(C_new_i) || std::isinf(C_new_v) || std::isnan(C_new_i) || std::isnan(C_new_v))
+      {
+        [[maybe_unused]] const double values[] = {C_new_i, C_new_v}; // Species 0 is C_i, 1 is C_v, read only by traced builds
+        MMD_TRACE_CHECK_FINITE("MFRT step", values, 2, 0);
+        result.status = Status::LimitReached;
+        return result;
+      }
+
+      C_i = C_new[0];
+      C_v = C_new[1];
+
+      // Fixed steps recompute t from the step count so rounding error does not accumulate
+      ++result.steps;
+      MMD_TRACE_COUNT("steps", 1);
+      t = last ? p.total_time : (p.adaptive ? t + h : result.steps * dt);
+
+      sample_counter += h;
+      if (sample_counter >= p.sample_interval)
+      {
+        // double sink_diff = K_is * C_i * C_s - K_vs * C_v * C_s;
+        sample_counter = 0.0;
+        on_sample(t, C_i, C_v);
+      }
+    }
+
+    return result;
+  }
+};
+
+using MFRTModel = BasicMFRTModel<double>;
+
+// A model that carries dC/dθ for every material parameter θ (PARAMETER_NAMES) through the same
+// single run, with the parameters seeded as the variables
+using MFRTDual = Dual<MFRTModel::NUM_PARAMETERS>;
+class MFRTSensitivityModel : public BasicMFRTModel<MFRTDual>
+{
+public:
+  MFRTSensitivityModel()
+  {
+    for (int p = 0; p < NUM_PARAMETERS; ++p) Parameter(p) = MFRTDual::Variable(ValueOf(Parameter(p)), p);
+  }
+};
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "TGraph.h"
+#include "TCanvas.h"
+#include "TMultiGraph.h"
+#include "TApplication.h"
+#include "TRootCanvas.h"
+
+#include "../common/columns.hpp"
+
+// Plots C_i and C_v from an mfrt output file (CSV or binary). For sweep outputs, the case to plot
+// is the second argument.
+int main(int argc, char** argv)
+{
+  const std::string file_name = argc < 2 ? "mfrt.csv" : argv[1];
+  const double plot_case = argc < 3 ? 0 : std::stod(argv[2]);
+
+  ColumnReader reader(file_name);
+  const int t_column = reader.Find("t");
+  const int ci_column = reader.Find("C_i");
+  const int cv_column = reader.Find("C_v");
+  const int case_column = reader.Find("case");
+  if (t_column < 0 || ci_column < 0 || cv_column < 0)
+  {
+    std::cerr << file_name << " has no t, C_i and C_v columns" << std::endl;
+    return 1;
+  }
+
+  // Define the application start point and the name <- args of main.
+  TApplication app("app", &argc, argv);
+
+  // Define the 'canvas' aka main window
+  TCanvas* c = new TCanvas("c", "Sim", 0, 0, 800, 600);
+  
+  // c->SetLogy();
+  
+  // Define the graphs
+  TGraph* ci_graph = new TGraph();
+  TGraph* cv_graph = new TGraph();
+
+  ci_graph->SetMarkerColor(kRed);
+  cv_graph->SetMarkerColor(kBlue);
+
+	ci_graph->SetTitle("C_i");
+	cv_graph->SetTitle("C_v");
+
+  TMultiGraph* mg = new TMultiGraph();
+
+  std::vector<std::vector<double>> columns;
+  while (reader.Next(columns)) {
+    for (size_t r = 0; r < columns[t_column].size(); ++r)
+    {
+      if (case_column >= 0 && columns[case_column][r] != plot_case) continue;
+      ci_graph->AddPoint(columns[t_column][r], columns[ci_column][r]);
+      cv_graph->AddPoint(columns[t_column][r], columns[cv_column][r]);
+    }
+  }
+  
+  mg->Add(ci_graph);
+  mg->Add(cv_graph);
+
+  mg->SetTitle("MFRT");
+  mg->Draw("ALP");
+  
+  // Graph config / color
+  c->Modified(); c->Update();
+  TRootCanvas *rc = (TRootCanvas *)c->GetCanvasImp();
+
+  // Term app on window close
+  rc->Connect("CloseWindow()", "TApplication", gApplication, "Terminate()");
+
+  // App run
+  app.Run();
+
+  return 0;
+}
\ No newline at end of file
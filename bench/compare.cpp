@@ -0,0 +1,77 @@
+// Diffs two benchmark result files written with --json, typically a baseline from the main
+// branch and the current build. Prints the change in ns per step and allocations per step for
+// every benchmark present in both, and exits with 1 if any got slower by more than the threshold
+// (default 10%) or allocates more per step than before.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include "../vendor/nlohmann/json.hpp"
+
+static nlohmann::json Load(const std::string& path)
+{
+  std::ifstream file(path);
+  if (!file.good())
+  {
+    std::cerr << "Could not open " << path << std::endl;
+    std::exit(2);
+  }
+  return nlohmann::json::parse(file);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    std::cout << "Usage: compare baseline.json current.json [threshold]" << std::endl;
+    return 2;
+  }
+  const nlohmann::json baseline = Load(argv[1]);
+  const nlohmann::json current = Load(argv[2]);
+  const double threshold = argc > 3 ? std::atof(argv[3]) : 0.10;
+
+  // Baseline results by suite and benchmark name
+  std::map<std::string, const nlohmann::json*> before;
+  for (const auto& [suite, benchmarks] : baseline.at("suites").items()) {
+    for (const nlohmann::json& b : benchmarks) before[suite + ":" + b.at("name").get<std::string>()] = &b;
+  }
+
+  std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(14) << "ns/step was"
+            << std::setw(14) << "ns/step now" << std::setw(10) << "change" << std::setw(14) << "allocs was"
+            << std::setw(14) << "allocs now" << std::endl;
+
+  int regressions = 0;
+  for (const auto& [suite, benchmarks] : current.at("suites").items()) {
+    for (const nlohmann::json& now : benchmarks)
+    {
+      const std::string name = now.at("name");
+      const auto found = before.find(suite + ":" + name);
+      if (found == before.end())
+      {
+        std::cout << std::left << std::setw(40) << name << "  new" << std::endl;
+        continue;
+      }
+      const nlohmann::json& was = *found->second;
+
+      const double ns_was = was.at("ns_per_step"), ns_now = now.at("ns_per_step");
+      const double allocs_was = was.at("allocations_per_step"), allocs_now = now.at("allocations_per_step");
+      const double change = ns_now / ns_was - 1.0;
+
+      const bool slower = change > threshold;
+      const bool allocates = allocs_now > allocs_was;
+      if (slower || allocates) ++regressions;
+
+      std::cout << std::left << std::setw(40) << name << std::right << std::setw(14) << ns_was << std::setw(14) << ns_now
+                << std::setw(9) << std::fixed << std::setprecision(1) << 100.0 * change << "%" << std::defaultfloat << std::setprecision(6)
+                << std::setw(14) << allocs_was << std::setw(14) << allocs_now
+                << (slower || allocates ? "  REGRESSION" : "") << std::endl;
+    }
+  }
+
+  if (regressions > 0) std::cout << regressions << " regression(s) beyond " << 100.0 * threshold << "%" << std::endl;
+  return regressions > 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../vendor/nlohmann/json.hpp"
+
+// Self contained benchmark harness shared by the solver benchmarks.
+//
+// Each benchmark times a unit of work ("step") for at least --min-time seconds and reports
+// ns per step, steps per second, ns per species update and heap allocations per step. With
+// --json file the results are also merged into file under the benchmark's suite name, so the
+// suites of one build can share a file and compare diffs it against a baseline.
+//
+// Include this in exactly one translation unit per binary: it replaces the global operator new
+// to count allocations.
+
+namespace bench_detail
+{
+  inline std::atomic<long> allocations{0};
+
+  inline void* Allocate(size_t n, size_t alignment)
+  {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, (n + alignment - 1) / alignment * alignment) : std::malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+  }
+}
+
+void* operator new(size_t n) { return bench_detail::Allocate(n, 0); }
+void* operator new[](size_t n) { return bench_detail::Allocate(n, 0); }
+void* operator new(size_t n, std::align_val_t a) { return bench_detail::Allocate(n, static_cast<size_t>(a)); }
+void* operator new[](size_t n, std::align_val_t a) { return bench_detail::Allocate(n, static_cast<size_t>(a)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+class BenchSuite
+{
+public:
+  struct Result
+  {
+    std::string name;
+    int species; // Concentrations updated per step
+    long steps; // Steps timed
+    double ns_per_step;
+    double allocations_per_step;
+  };
+
+  // Reads --json file, --filter text (only run benchmarks whose name contains it) and
+  // --min-time seconds. Exits with a usage message on anything else.
+  BenchSuite(std::string suite, int argc, char** argv) : suite(std::move(suite))
+  {
+    for (int a = 1; a < argc; ++a)
+    {
+      const bool has_value = a + 1 < argc;
+      if (std::strcmp(argv[a], "--json") == 0 && has_value) json_file = argv[++a];
+      else if (std::strcmp(argv[a], "--filter") == 0 && has_value) filter = argv[++a];
+      else if (std::strcmp(argv[a], "--min-time") == 0 && has_value) min_time = std::atof(argv[++a]);
+      else
+      {
+        std::cout << "Usage: " << argv[0] << " [--json file] [--filter text] [--min-time seconds]" << std::endl;
+        std::exit(1);
+      }
+    }
+
+    std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(10) << "species"
+              << std::setw(14) << "ns/step" << std::setw(14) << "steps/s" << std::setw(14) << "ns/species"
+              << std::setw(12) << "allocs/step" << std::endl;
+  }
+
+  // Times step(), which advances steps_per_call steps each call. One untimed call first warms
+  // caches and lets lazily sized work arrays settle.
+  template <typename Step>
+  void Run(const std::string& name, int species, long steps_per_call, Step&& step)
+  {
+    if (!filter.empty() && name.find(filter) == std::string::npos) return;
+
+    using Clock = std::chrono::steady_clock;
+    step();
+
+    long calls = 0;
+    const long allocations_before = bench_detail::allocations.load();
+    const auto start = Clock::now();
+    auto end = start;
+    do
+    {
+      step();
+      ++calls;
+      end = Clock::now();
+    } while (std::chrono::duration<double>(end - start).count() < min_time);
+    const long allocations = bench_detail::allocations.load() - allocations_before;
+
+    Result r;
+    r.name = name;
+    r.species = species;
+    r.steps = calls * steps_per_call;
+    r.ns_per_step = std::chrono::duration<double, std::nano>(end - start).count() / r.steps;
+    r.allocations_per_step = static_cast<double>(allocations) / r.steps;
+    results.push_back(r);
+
+    std::cout << std::left << std::setw(40) << name << std::right << std::setw(10) << species
+              << std::setw(14) << r.ns_per_step << std::setw(14) << 1e9 / r.ns_per_step
+              << std::setw(14) << r.ns_per_step / species << std::setw(12) << r.allocations_per_step << std::endl;
+  }
+
+  // Merges the results into the --json file, if one was given, replacing this suite's previous results
+  void WriteJson() const
+  {
+    if (json_file.empty()) return;
+
+    nlohmann::json file = {{"suites", nlohmann::json::object()}};
+    std::ifstream existing(json_file);
+    if (existing.good())
+    {
+      nlohmann::json previous = nlohmann::json::parse(existing, nullptr, false);
+      if (previous.is_object() && previous.contains("suites")) file = previous;
+    }
+
+    nlohmann::json benchmarks = nlohmann::json::array();
+    for (const Result& r : results)
+    {
+      benchmarks.push_back({
+        {"name", r.name},
+        {"species", r.species},
+        {"steps", r.steps},
+        {"ns_per_step", r.ns_per_step},
+        {"steps_per_second", 1e9 / r.ns_per_step},
+        {"ns_per_species_update", r.ns_per_step / r.species},
+        {"allocations_per_step", r.allocations_per_step}
+      });
+    }
+    file["suites"][suite] = benchmarks;
+
+    std::ofstream out(json_file);
+    out << file.dump(2) << "\n";
+  }
+
+private:
+  const std::string suite;
+  std::string json_file;
+  std::string filter;
+  double min_time = 0.5;
+  std::vector<Result> results;
+};
\ No newline at end of file
@@ -0,0 +1,82 @@
+// Per step cost of CD_Kohnert across cluster size ranges, for each integrator, plus the reaction
+// rate evaluation on its own, a large state split over threads and batched ensembles of small states.
+
+#include <thread>
+
+#include "harness.hpp"
+#include "../CD_Kohnert/src/cd.hpp"
+#include "../CD_Kohnert/src/ensemble.hpp"
+#include "../CD_Kohnert/src/run.hpp"
+
+int main(int argc, char** argv)
+{
+  BenchSuite suite("kohnert", argc, argv);
+
+  struct Case
+  {
+    std::string label;
+    int max_size;
+    int group_threshold;
+  };
+  const std::vector<Case> cases = {{"40", 40, 0}, {"200", 200, 0}, {"1000", 1000, 0}, {"10000", 10000, 0}, {"100000/grouped", 100000, 100}};
+
+  for (const Case& c : cases)
+  {
+    RunOptions options;
+    options.max_size = c.max_size;
+    options.group_threshold = c.group_threshold;
+
+    std::unique_ptr<CDState> cd = MakeState(options);
+    const int species = 2 * cd->state_size + 1;
+
+    CDState::Concentrations R(cd->state_size);
+    suite.Run("kohnert/reaction_rates/" + c.label, species, 1, [&] { cd->GetReactionRates(cd->species.C, R); });
+
+    // Explicit steps stay tiny so the state never blows up however long the timing runs
+    for (const char* integrator : {"euler", "bdf", "rosenbrock"})
+    {
+      options.integrator = integrator;
+      cd = MakeState(options);
+      const double dt = options.integrator == "euler" ? 1e-9 : 1e-3;
+      suite.Run("kohnert/step/" + options.integrator + "/" + c.label, species, 1, [&] { cd->Step(dt); });
+    }
+
+    // The same explicit steps reusing the flux terms of sizes that barely move, see LazyFlux
+    options.integrator = "euler";
+    options.lazy_flux = 1e-6;
+    cd = MakeState(options);
+    suite.Run("kohnert/step/euler/lazy/" + c.label, species, 1, [&] { cd->Step(1e-9); });
+  }
+
+  // One large state split over every power of two threads the machine has, to compare with
+  // kohnert/step/euler/10000
+  for (unsigned threads = 2; threads <= std::thread::hardware_concurrency(); threads *= 2)
+  {
+    RunOptions options;
+    options.max_size = 10000;
+    options.threads = threads;
+    std::unique_ptr<CDState> cd = MakeState(options);
+    suite.Run("kohnert/step/euler/10000/threads" + std::to_string(threads), 2 * cd->state_size + 1, 1, [&] { cd->Step(1e-9); });
+  }
+
+  // Ensembles of the default size, counted per member species so ns per species update compares
+  // directly with kohnert/step/euler/40
+  for (int members : {1, 8, 16, 32})
+  {
+    RunOptions options;
+    std::vector<std::unique_ptr<CDState>> states;
+    std::vector<const CDState*> pointers;
+    for (int m = 0; m < members; ++m)
+    {
+      options.temperature = 300.0 + 10.0 * m;
+      states.push_back(MakeState(options));
+      pointers.push_back(states.back().get());
+    }
+
+    Ensemble ensemble(pointers);
+    const int species = members * (2 * states.front()->state_size + 1);
+    suite.Run("kohnert/ensemble/euler/40/x" + std::to_string(members), species, 1, [&] { ensemble.Step(1e-9); });
+  }
+
+  suite.WriteJson();
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+// Per step cost of the MFRT model loop, on the parameters of MFRT/config.json
+
+#include "harness.hpp"
+#include "../MFRT/model.hpp"
+
+int main(int argc, char** argv)
+{
+  BenchSuite suite("mfrt", argc, argv);
+
+  MFRTParameters p;
+  p.total_time = 50000;
+  p.dt = 100;
+  p.temperature = 350;
+  p.K_0_exp = 10;
+  p.C_s_exp = 8;
+  p.sample_interval = 1;
+
+  for (bool adaptive : {false, true})
+  {
+    p.adaptive = adaptive;
+
+    double sum = 0.0; // Consumed so the samples are not optimized away
+    auto run = [&] {
+      MFRTModel model;
+      return model.Run(p, [&](double, double C_i, double C_v) { sum += C_i + C_v; });
+    };
+
+    const long steps = run().steps;
+    suite.Run(std::string("mfrt/run/") + (adaptive ? "adaptive" : "fixed"), 2, steps, run);
+    if (sum < 0) std::cout << sum << std::endl;
+  }
+
+  suite.WriteJson();
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+// Micro-benchmark of the CD_Pokor rate evaluation: the tabulated flux kernel (GetDerivatives)
+// against the per-size member function path (GetDerivativesScalar), in ns per cluster size.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+
+#include "../CD_Pokor/src/cd.hpp"
+
+template <typename F>
+double NsPerCall(F&& f, int min_calls)
+{
+  using Clock = std::chrono::steady_clock;
+
+  long calls = 0;
+  const auto start = Clock::now();
+  auto end = start;
+  do
+  {
+    for (int c = 0; c < min_calls; ++c) f();
+    calls += min_calls;
+    end = Clock::now();
+  } while (end - start < std::chrono::milliseconds(200));
+
+  return std::chrono::duration<double, std::nano>(end - start).count() / calls;
+}
+
+int main()
+{
+  std::cout << std::setw(8) << "sizes" << std::setw(14) << "batch ns/n" << std::setw(14) << "scalar ns/n"
+            << std::setw(10) << "speedup" << std::setw(14) << "step ns/n" << std::setw(14) << "max diff" << std::endl;
+
+  for (int N : {20, 100, 1000, 10000, 100000})
+  {
+    CDState cd(N);
+    cd.Init();
+
+    CDState::State y(2 * N + 1), batch(2 * N + 1), scalar(2 * N + 1);
+    for (size_t i = 0; i < y.size(); ++i) y[i] = 1e-6 / (1 + i % N);
+    cd.SetState(y);
+
+    cd.GetDerivatives(y, batch);
+    cd.GetDerivativesScalar(y, scalar);
+    double max_diff = 0.0;
+    for (size_t i = 0; i < y.size(); ++i) max_diff = std::max(max_diff, std::abs(batch[i] - scalar[i]) / (std::abs(scalar[i]) + 1e-300));
+
+    const int min_calls = std::max(1, 100000 / N);
+    const double batch_ns = NsPerCall([&] { cd.GetDerivatives(y, batch); }, min_calls);
+    const double scalar_ns = NsPerCall([&] { cd.GetDerivativesScalar(y, scalar); }, min_calls);
+    const double step_ns = NsPerCall([&] { cd.Step(1e-9); }, min_calls);
+
+    // Two defect types per cluster size
+    std::cout << std::setw(8) << N << std::setw(14) << batch_ns / (2 * N) << std::setw(14) << scalar_ns / (2 * N)
+              << std::setw(10) << scalar_ns / batch_ns << std::setw(14) << step_ns / (2 * N)
+              << std::setw(14) << max_diff << std::endl;
+  }
+}
\ No newline at end of file
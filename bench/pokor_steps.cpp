@@ -0,0 +1,24 @@
+// Per step cost of CD_Pokor across cluster size ranges, fixed and error controlled
+
+#include "harness.hpp"
+#include "../CD_Pokor/src/cd.hpp"
+
+int main(int argc, char** argv)
+{
+  BenchSuite suite("pokor", argc, argv);
+
+  for (int N : {20, 100, 1000, 10000, 100000})
+  {
+    const int species = 2 * N + 1;
+
+    CDState cd(N);
+    cd.Init();
+    suite.Run("pokor/step/" + std::to_string(N), species, 1, [&] { cd.Step(1e-9); });
+
+    CDState::State y(species), dydt(species);
+    for (int i = 0; i < species; ++i) y[i] = 1e-6 / (1 + i % N);
+    suite.Run("pokor/derivatives/" + std::to_string(N), species, 1, [&] { cd.GetDerivatives(y, dydt); });
+  }
+
+  suite.WriteJson();
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+// Throughput against accuracy of the precision policies (common/precision.hpp) on CD_Kohnert
+// ensembles. Timings are per ensemble step, as kohnert/ensemble/*. The accuracy table then compares
+// each policy's concentrations after many small forward Euler steps with the same steps summed in
+// long double, from the same double increments, so it shows the rounding each policy's updates
+// lose and nothing else.
+
+#include <algorithm>
+#include <cmath>
+
+#include "harness.hpp"
+#include "../CD_Kohnert/src/cd.hpp"
+#include "../CD_Kohnert/src/ensemble.hpp"
+#include "../CD_Kohnert/src/run.hpp"
+
+namespace
+{
+  constexpr int MEMBERS = 32;
+  constexpr int ACCURACY_MEMBERS = 8;
+  constexpr int ACCURACY_STEPS = 100000;
+  constexpr double DT = 1e-9;
+  constexpr double SMALLEST = 1e-30; // Concentrations below are left out of the relative errors
+
+  std::vector<std::unique_ptr<CDState>> MakeMembers(int max_size, int members)
+  {
+    RunOptions options;
+    options.max_size = max_size;
+    std::vector<std::unique_ptr<CDState>> states;
+    for (int m = 0; m < members; ++m)
+    {
+      options.temperature = 300.0 + 10.0 * m;
+      states.push_back(MakeState(options));
+    }
+    return states;
+  }
+
+  std::vector<const CDState*> Pointers(const std::vector<std::unique_ptr<CDState>>& states)
+  {
+    std::vector<const CDState*> pointers;
+    for (const auto& s : states) pointers.push_back(s.get());
+    return pointers;
+  }
+
+  // Largest and mean relative error of ensemble against reference, by member and species
+  template <typename Policy>
+  void PrintAccuracy(const std::vector<std::unique_ptr<CDState>>& states, const std::vector<std::vector<long double>>& reference)
+  {
+    BasicEnsemble<Policy> ensemble(Pointers(states));
+    for (int s = 0; s < ACCURACY_STEPS; ++s) ensemble.Step(DT);
+
+    double max_error = 0.0, sum_error = 0.0;
+    long count = 0;
+    CDState::Concentrations C;
+    for (int m = 0; m < ensemble.Size(); ++m)
+    {
+      ensemble.GetConcentrations(m, C);
+      for (int i = -ensemble.state_size; i <= ensemble.state_size; ++i)
+      {
+        const long double exact = reference[m][i + ensemble.state_size];
+        if (std::abs(exact) < SMALLEST) continue;
+        const double error = static_cast<double>(std::abs((C[i] - exact) / exact));
+        max_error = std::max(max_error, error);
+        sum_error += error;
+        ++count;
+      }
+    }
+
+    std::cout << std::left << std::setw(40) << Policy::NAME << std::right << std::setw(14) << max_error
+              << std::setw(14) << sum_error / std::max(count, 1L) << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  BenchSuite suite("precision", argc, argv);
+
+  for (int max_size : {40, 1000})
+  {
+    const auto states = MakeMembers(max_size, MEMBERS);
+    const int species = MEMBERS * (2 * states.front()->state_size + 1);
+    const std::string size = std::to_string(max_size) + "/x" + std::to_string(MEMBERS);
+
+    for (const char* name : {DoublePrecision::NAME, CompensatedPrecision::NAME, SinglePrecision::NAME})
+    {
+      WithPrecision(name, [&](auto policy) {
+        BasicEnsemble<decltype(policy)> ensemble(Pointers(states));
+        suite.Run(std::string("precision/ensemble/") + name + "/" + size, species, 1, [&] { ensemble.Step(DT); });
+      });
+    }
+  }
+
+  suite.WriteJson();
+
+  // The reference takes each member's own derivatives at its state rounded to double, as
+  // ForwardEuler would, and sums the increments in long double
+  const auto states = MakeMembers(40, ACCURACY_MEMBERS);
+  std::vector<std::vector<long double>> reference;
+  for (const auto& cd : states)
+  {
+    CDState::Concentrations C, dCdt;
+    cd->GetConcentrations(C);
+    dCdt.resize(cd->state_size);
+    std::vector<long double> exact(2 * cd->state_size + 1);
+    for (int i = -cd->state_size; i <= cd->state_size; ++i) exact[i + cd->state_size] = C[i];
+
+    for (int s = 0; s < ACCURACY_STEPS; ++s)
+    {
+      for (int i = -cd->state_size; i <= cd->state_size; ++i) C[i] = static_cast<double>(exact[i + cd->state_size]);
+      cd->GetDerivatives(C, dCdt);
+      for (int i = -cd->state_size; i <= cd->state_size; ++i) exact[i + cd->state_size] += DT * dCdt[i];
+    }
+    reference.push_back(std::move(exact));
+  }
+
+  std::cout << "\nRelative error after " << ACCURACY_STEPS << " steps of " << DT << " s, max size 40 x" << ACCURACY_MEMBERS << "\n"
+            << std::left << std::setw(40) << "precision" << std::right << std::setw(14) << "max" << std::setw(14) << "mean" << std::endl;
+  PrintAccuracy<DoublePrecision>(states, reference);
+  PrintAccuracy<CompensatedPrecision>(states, reference);
+  PrintAccuracy<SinglePrecision>(states, reference);
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Error control shared by the adaptive drivers of MFRT, CD_Kohnert and CD_Pokor
+
+// Value of a state component for error control. Scalar types that carry more than a value (see
+// dual.hpp) overload this, so steps are controlled on the value alone.
+inline double ValueOf(double x) { return x; }
+
+struct Tolerances
+{
+  double rtol = 1e-6; // Relative tolerance
+  double atol = 1e-12; // Absolute tolerance, in the model's concentration units
+};
+
+// Weighted RMS norm of a local error estimate. Each component is scaled by
+// atol + rtol * max(|y_old|, |y_new|), so a norm <= 1 means the step is within tolerance.
+class ErrorNorm
+{
+public:
+  explicit ErrorNorm(const Tolerances& tol) : tol(tol) {}
+
+  void Add(double error, double y_old, double y_new)
+  {
+    const double scale = tol.atol + tol.rtol * std::max(std::abs(y_old), std::abs(y_new));
+    const double e = error / scale;
+    sum += e * e;
+    ++count;
+  }
+
+  double Value() const
+  {
+    if (count == 0) return 0.0;
+    const double value = std::sqrt(sum / count);
+    return std::isnan(value) ? HUGE_VAL : value;
+  }
+
+private:
+  Tolerances tol;
+  double sum = 0.0;
+  size_t count = 0;
+};
+
+// PI step size controller (Hairer & Wanner, Solving ODEs II, IV.2).
+// order is the order of the embedded error estimate.
+class StepController
+{
+public:
+  explicit StepController(int order = 4)
+    : alpha(0.7 / (order + 1)), beta(0.4 / (order + 1)), order(order)
+  {
+  }
+
+  static bool Accept(double error) { return error <= 1.0; }
+
+  // Returns the step to try next after a step of length dt produced this error
+  double NextDt(double dt, double error)
+  {
+    double factor;
+    if (error == 0.0)
+    {
+      factor = max_factor;
+    }
+    else if (Accept(error))
+    {
+      factor = safety * std::pow(error, -alpha) * std::pow(prev_error, beta);
+      prev_error = std::max(error, 1e-4);
+    }
+    else
+    {
+      factor = safety * std::pow(error, -1.0 / (order + 1)); // No PI memory on rejection
+    }
+
+    return dt * std::clamp(factor, min_factor, max_factor);
+  }
+
+  // Error of the last accepted step, the controller's only state between steps
+  double Memory() const { return prev_error; }
+  void SetMemory(double error) { prev_error = error; }
+
+  double min_factor = 0.2;
+  double max_factor = 5.0;
+  double safety = 0.9;
+
+private:
+  double alpha;
+  double beta;
+  int order;
+  double prev_error = 1e-4;
+};
+
+// Stage storage for DormandPrinceStep, kept by the caller so repeated steps don't allocate
+template <typename State>
+struct DormandPrinceWork
+{
+  State k1, k2, k3, k4, k5, k6, k7, stage;
+};
+
+// One Dormand-Prince 5(4) step from y to y_new, returning the error norm of the embedded 4th
+// order solution. rhs(y, dydt) must fill dydt = f(y). State needs size() and operator[].
+template <typename State, typename Rhs>
+double DormandPrinceStep(Rhs&& rhs, const State& y, State& y_new, double dt, const Tolerances& tol, DormandPrinceWork<State>& work)
+{
+  constexpr double c21 = 1.0 / 5;
+  constexpr double c31 = 3.0 / 40, c32 = 9.0 / 40;
+  constexpr double c41 = 44.0 / 45, c42 = -56.0 / 15, c43 = 32.0 / 9;
+  constexpr double c51 = 19372.0 / 6561, c52 = -25360.0 / 2187, c53 = 64448.0 / 6561, c54 = -212.0 / 729;
+  constexpr double c61 = 9017.0 / 3168, c62 = -355.0 / 33, c63 = 46732.0 / 5247, c64 = 49.0 / 176, c65 = -5103.0 / 18656;
+  constexpr double b1 = 35.0 / 384, b3 = 500.0 / 1113, b4 = 125.0 / 192, b5 = -2187.0 / 6784, b6 = 11.0 / 84;
+  // Difference between the 5th and 4th order weights
+  constexpr double e1 = 71.0 / 57600, e3 = -71.0 / 16695, e4 = 71.0 / 1920, e5 = -17253.0 / 339200, e6 = 22.0 / 525, e7 = -1.0 / 40;
+
+  const size_t n = y.size();
+  if (work.k1.size() != n) work = {y, y, y, y, y, y, y, y};
+  State& k1 = work.k1; State& k2 = work.k2; State& k3 = work.k3; State& k4 = work.k4;
+  State& k5 = work.k5; State& k6 = work.k6; State& k7 = work.k7; State& stage = work.stage;
+
+  rhs(y, k1);
+  for (size_t i = 0; i < n; ++i) stage[i] = y[i] + dt * c21 * k1[i];
+  rhs(stage, k2);
+  for (size_t i = 0; i < n; ++i) stage[i] = y[i] + dt * (c31 * k1[i] + c32 * k2[i]);
+  rhs(stage, k3);
+  for (size_t i = 0; i < n; ++i) stage[i] = y[i] + dt * (c41 * k1[i] + c42 * k2[i] + c43 * k3[i]);
+  rhs(stage, k4);
+  for (size_t i = 0; i < n; ++i) stage[i] = y[i] + dt * (c51 * k1[i] + c52 * k2[i] + c53 * k3[i] + c54 * k4[i]);
+  rhs(stage, k5);
+  for (size_t i = 0; i < n; ++i) stage[i] = y[i] + dt * (c61 * k1[i] + c62 * k2[i] + c63 * k3[i] + c64 * k4[i] + c65 * k5[i]);
+  rhs(stage, k6);
+  for (size_t i = 0; i < n; ++i) y_new[i] = y[i] + dt * (b1 * k1[i] + b3 * k3[i] + b4 * k4[i] + b5 * k5[i] + b6 * k6[i]);
+  rhs(y_new, k7);
+
+  ErrorNorm norm(tol);
+  for (size_t i = 0; i < n; ++i)
+  {
+    const auto error = dt * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]);
+    norm.Add(ValueOf(error), ValueOf(y[i]), ValueOf(y_new[i]));
+  }
+  return norm.Value();
+}
\ No newline at end of file
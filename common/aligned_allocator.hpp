@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Allocator for cache line aligned vectors, so concentration and rate arrays start on a 64 byte
+// boundary and the compiler can use aligned vector loads in the hot loops.
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+  using value_type = T;
+
+  template <typename U>
+  struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T* p, size_t)
+  {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Aligned allocator that leaves elements of trivial types uninitialized when a vector is resized,
+// so its memory pages aren't touched until they are first written, see FirstTouch in
+// common/fork_join.hpp. Vectors of it must be given a value to fill with wherever they should be zero.
+template <typename T, size_t Alignment = 64>
+struct FirstTouchAllocator : AlignedAllocator<T, Alignment>
+{
+  template <typename U>
+  struct rebind { using other = FirstTouchAllocator<U, Alignment>; };
+
+  FirstTouchAllocator() = default;
+
+  template <typename U>
+  FirstTouchAllocator(const FirstTouchAllocator<U, Alignment>&) {}
+
+  template <typename U>
+  void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+};
+
+template <typename T>
+using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
\ No newline at end of file
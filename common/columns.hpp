@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ring_buffer.hpp"
+
+// Streaming output of rows of named float64 columns, as CSV or as a compact binary columnar file.
+// Rows are buffered and written in chunks, so memory use doesn't grow with the length of a run.
+//
+// Binary layout, native byte order:
+//   "MMDCOL1" and a zero byte
+//   uint32 column count, then per column a uint32 name length and the name
+//   chunks until the end of the file: uint32 row count, then each column's values as float64
+// A file cut short by a crash is still readable up to its last complete chunk.
+//
+// The compressed binary layout ("MMDCOL2") has the same header, and in each chunk every column is
+// a uint32 byte count followed by its values XOR coded against the value before in the column (see
+// CompressedColumnWriter). Each chunk starts afresh, so it stays readable up to the last one.
+
+class ColumnWriter
+{
+public:
+  explicit ColumnWriter(std::vector<std::string> names) : names(std::move(names)) {}
+  virtual ~ColumnWriter() = default;
+
+  size_t NumColumns() const { return names.size(); }
+  const std::vector<std::string>& Names() const { return names; }
+
+  virtual void Write(const double* row) = 0; // One value per column
+  virtual void Flush() = 0;
+
+protected:
+  std::vector<std::string> names;
+};
+
+class CsvColumnWriter : public ColumnWriter
+{
+public:
+  static constexpr size_t BUFFER_BYTES = 1 << 16;
+
+  CsvColumnWriter(const std::string& path, std::vector<std::string> names)
+    : ColumnWriter(std::move(names)), file(path)
+  {
+    if (!file.good()) throw std::runtime_error("Could not open " + path);
+
+    for (size_t c = 0; c < NumColumns(); ++c) buffer << (c ? "," : "") << this->names[c];
+    buffer << "\n";
+    buffer.precision(std::numeric_limits<double>::max_digits10);
+  }
+
+  ~CsvColumnWriter() override { Flush(); }
+
+  void Write(const double* row) override
+  {
+    for (size_t c = 0; c < NumColumns(); ++c) buffer << (c ? "," : "") << row[c];
+    buffer << "\n";
+    if (buffer.tellp() >= static_cast<std::streamoff>(BUFFER_BYTES)) Flush();
+  }
+
+  void Flush() override
+  {
+    file << buffer.str();
+    file.flush();
+    buffer.str("");
+  }
+
+private:
+  std::ofstream file;
+  std::ostringstream buffer;
+};
+
+class BinaryColumnWriter : public ColumnWriter
+{
+public:
+  static constexpr char MAGIC[8] = "MMDCOL1";
+  static constexpr uint32_t CHUNK_ROWS = 4096;
+
+  BinaryColumnWriter(const std::string& path, std::vector<std::string> names)
+    : ColumnWriter(std::move(names)), file(path, std::ios::binary), columns(NumColumns())
+  {
+    if (!file.good()) throw std::runtime_error("Could not open " + path);
+
+    file.write(MAGIC, sizeof(MAGIC));
+    WriteValue(static_cast<uint32_t>(NumColumns()));
+    for (const std::string& name : this->names)
+    {
+      WriteValue(static_cast<uint32_t>(name.size()));
+      file.write(name.data(), name.size());
+    }
+
+    for (std::vector<double>& column : columns) column.reserve(CHUNK_ROWS);
+  }
+
+  ~BinaryColumnWriter() override { Flush(); }
+
+  void Write(const double* row) override
+  {
+    for (size_t c = 0; c < NumColumns(); ++c) columns[c].push_back(row[c]);
+    if (++rows == CHUNK_ROWS) Flush();
+  }
+
+  void Flush() override
+  {
+    if (rows > 0)
+    {
+      WriteValue(rows);
+      for (std::vector<double>& column : columns)
+      {
+        file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(double));
+        column.clear();
+      }
+      rows = 0;
+    }
+    file.flush();
+  }
+
+private:
+  std::ofstream file;
+  std::vector<std::vector<double>> columns; // The chunk being filled
+  uint32_t rows = 0;
+
+  template <typename T>
+  void WriteValue(T value) { file.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+};
+
+// Binary columns with each value stored as its XOR with the one before in the column, as a byte of
+// leading zero bytes (high nibble) and trailing zero bytes (low nibble), then the bytes between,
+// least significant first. Slowly changing values share their sign, exponent and top of the
+// mantissa with the one before, so a smooth trajectory takes a fraction of the plain binary size,
+// and a value that repeats takes one byte. Lossless.
+class CompressedColumnWriter : public ColumnWriter
+{
+public:
+  static constexpr char MAGIC[8] = "MMDCOL2";
+  static constexpr uint32_t CHUNK_ROWS = 4096;
+
+  CompressedColumnWriter(const std::string& path, std::vector<std::string> names)
+    : ColumnWriter(std::move(names)), file(path, std::ios::binary), columns(NumColumns()), previous(NumColumns(), 0)
+  {
+    if (!file.good()) throw std::runtime_error("Could not open " + path);
+
+    file.write(MAGIC, sizeof(MAGIC));
+    WriteValue(static_cast<uint32_t>(NumColumns()));
+    for (const std::string& name : this->names)
+    {
+      WriteValue(static_cast<uint32_t>(name.size()));
+      file.write(name.data(), name.size());
+    }
+  }
+
+  ~CompressedColumnWriter() override { Flush(); }
+
+  void Write(const double* row) override
+  {
+    for (size_t c = 0; c < NumColumns(); ++c)
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &row[c], sizeof(bits));
+      Encode(bits ^ previous[c], columns[c]);
+      previous[c] = bits;
+    }
+    if (++rows == CHUNK_ROWS) Flush();
+  }
+
+  void Flush() override
+  {
+    if (rows > 0)
+    {
+      WriteValue(rows);
+      for (std::string& column : columns)
+      {
+        WriteValue(static_cast<uint32_t>(column.size()));
+        file.write(column.data(), column.size());
+        column.clear();
+      }
+      std::fill(previous.begin(), previous.end(), 0);
+      rows = 0;
+    }
+    file.flush();
+  }
+
+  static void Encode(uint64_t x, std::string& out)
+  {
+    int lead = 0, trail = 0;
+    while (lead < 8 && (x >> (56 - 8 * lead) & 0xff) == 0) ++lead;
+    while (lead + trail < 8 && (x >> (8 * trail) & 0xff) == 0) ++trail;
+
+    out.push_back(static_cast<char>(lead << 4 | trail));
+    for (int b = trail; b < 8 - lead; ++b) out.push_back(static_cast<char>(x >> (8 * b) & 0xff));
+  }
+
+  // Decodes one value from data, returning the position after it, or nullptr past end
+  static const char* Decode(const char* data, const char* end, uint64_t& x)
+  {
+    if (data == end) return nullptr;
+    const int lead = static_cast<unsigned char>(*data) >> 4;
+    const int trail = *data & 0xf;
+    ++data;
+    if (lead + trail > 8 || end - data < 8 - lead - trail) return nullptr;
+
+    x = 0;
+    for (int b = trail; b < 8 - lead; ++b) x |= static_cast<uint64_t>(static_cast<unsigned char>(*data++)) << (8 * b);
+    return data;
+  }
+
+private:
+  std::ofstream file;
+  std::vector<std::string> columns; // Coded values of the chunk being filled
+  std::vector<uint64_t> previous; // Last value written in each column, as bits
+  uint32_t rows = 0;
+
+  template <typename T>
+  void WriteValue(T value) { file.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+};
+
+// Moves another writer's formatting and I/O to a background thread. Write copies the row into a
+// lock free ring and returns, and the thread drains the ring into the writer. Write only waits if
+// the writer falls a whole ring behind.
+class AsyncColumnWriter : public ColumnWriter
+{
+public:
+  static constexpr size_t DEFAULT_RING_BYTES = 1 << 24; // Split into as many rows as fit, at least 2
+  static constexpr std::chrono::microseconds IDLE_WAIT{200}; // Between looks at an empty ring
+
+  explicit AsyncColumnWriter(std::unique_ptr<ColumnWriter> writer, size_t ring_bytes = DEFAULT_RING_BYTES)
+    : ColumnWriter(writer->Names()), writer(std::move(writer)),
+      ring(NumColumns(), std::max<size_t>(2, ring_bytes / (sizeof(double) * std::max<size_t>(1, NumColumns())))),
+      thread(&AsyncColumnWriter::Loop, this)
+  {
+  }
+
+  ~AsyncColumnWriter() override // Writes out every row, then flushes
+  {
+    stopping.store(true, std::memory_order_release);
+    thread.join();
+  }
+
+  void Write(const double* row) override
+  {
+    while (!ring.TryPush(row)) std::this_thread::yield();
+  }
+
+  // Waits until every row so far is written and the writer flushed
+  void Flush() override
+  {
+    const uint64_t request = flush_requests.fetch_add(1, std::memory_order_release) + 1;
+    while (flushes_done.load(std::memory_order_acquire) < request) std::this_thread::yield();
+  }
+
+private:
+  std::unique_ptr<ColumnWriter> writer;
+  SpscRing<double> ring;
+  std::atomic<bool> stopping{false};
+  std::atomic<uint64_t> flush_requests{0}, flushes_done{0};
+
+  std::thread thread; // Last, so it starts after everything it uses
+
+  void Loop()
+  {
+    std::vector<double> row(NumColumns());
+    auto drain = [&] {
+      bool any = false;
+      while (ring.TryPop(row.data()))
+      {
+        writer->Write(row.data());
+        any = true;
+      }
+      return any;
+    };
+
+    for (;;)
+    {
+      const bool wrote = drain();
+
+      // Rows pushed before a request or the stop are visible once it is, so drain again first
+      const uint64_t requested = flush_requests.load(std::memory_order_acquire);
+      if (requested != flushes_done.load(std::memory_order_relaxed))
+      {
+        drain();
+        writer->Flush();
+        flushes_done.store(requested, std::memory_order_release);
+        continue;
+      }
+      if (stopping.load(std::memory_order_acquire))
+      {
+        drain();
+        writer->Flush();
+        return;
+      }
+      if (!wrote) std::this_thread::sleep_for(IDLE_WAIT);
+    }
+  }
+};
+
+// Compressed binary for paths ending in .cbin, binary for .bin, CSV otherwise
+inline std::unique_ptr<ColumnWriter> OpenColumnWriter(const std::string& path, std::vector<std::string> names)
+{
+  auto ends_with = [&](const char* suffix) {
+    const size_t n = std::strlen(suffix);
+    return path.size() >= n && path.compare(path.size() - n, n, suffix) == 0;
+  };
+  if (ends_with(".cbin")) return std::make_unique<CompressedColumnWriter>(path, std::move(names));
+  if (ends_with(".bin")) return std::make_unique<BinaryColumnWriter>(path, std::move(names));
+  return std::make_unique<CsvColumnWriter>(path, std::move(names));
+}
+
+// Reads a file from either writer a chunk at a time
+class ColumnReader
+{
+public:
+  explicit ColumnReader(const std::string& path)
+    : file(path, std::ios::binary)
+  {
+    if (!file.good()) throw std::runtime_error("Could not open " + path);
+
+    char magic[sizeof(BinaryColumnWriter::MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    compressed = file.gcount() == sizeof(magic) && std::memcmp(magic, CompressedColumnWriter::MAGIC, sizeof(magic)) == 0;
+    binary = compressed || (file.gcount() == sizeof(magic) && std::memcmp(magic, BinaryColumnWriter::MAGIC, sizeof(magic)) == 0);
+
+    if (binary)
+    {
+      const uint32_t count = ReadValue<uint32_t>();
+      for (uint32_t c = 0; c < count; ++c)
+      {
+        std::string name(ReadValue<uint32_t>(), '\0');
+        file.read(&name[0], name.size());
+        names.push_back(name);
+      }
+      if (!file) throw std::runtime_error("Truncated header in " + path);
+    }
+    else
+    {
+      file.clear();
+      file.seekg(0);
+
+      std::string header, name;
+      std::getline(file, header);
+      std::istringstream fields(header);
+      while (std::getline(fields, name, ',')) names.push_back(name);
+    }
+  }
+
+  const std::vector<std::string>& Names() const { return names; }
+
+  // Index of the named column, or -1
+  int Find(const std::string& name) const
+  {
+    for (size_t c = 0; c < names.size(); ++c) {
+      if (names[c] == name) return c;
+    }
+    return -1;
+  }
+
+  // Replaces columns with the next chunk of rows, one vector per column. False at the end of the file.
+  bool Next(std::vector<std::vector<double>>& columns)
+  {
+    columns.assign(names.size(), {});
+    if (compressed) return NextCompressed(columns);
+    return binary ? NextBinary(columns) : NextCsv(columns);
+  }
+
+private:
+  static constexpr size_t CSV_CHUNK_ROWS = 4096;
+
+  std::ifstream file;
+  bool binary = false;
+  bool compressed = false;
+  std::vector<std::string> names;
+
+  template <typename T>
+  T ReadValue()
+  {
+    T value{};
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+  }
+
+  bool NextBinary(std::vector<std::vector<double>>& columns)
+  {
+    const uint32_t rows = ReadValue<uint32_t>();
+    if (!file) return false;
+
+    for (std::vector<double>& column : columns)
+    {
+      column.resize(rows);
+      file.read(reinterpret_cast<char*>(column.data()), rows * sizeof(double));
+      if (!file) return false; // Incomplete last chunk
+    }
+    return true;
+  }
+
+  bool NextCompressed(std::vector<std::vector<double>>& columns)
+  {
+    const uint32_t rows = ReadValue<uint32_t>();
+    if (!file) return false;
+
+    std::string bytes;
+    for (std::vector<double>& column : columns)
+    {
+      bytes.resize(ReadValue<uint32_t>());
+      file.read(&bytes[0], bytes.size());
+      if (!file) return false; // Incomplete last chunk
+
+      const char* data = bytes.data();
+      const char* end = data + bytes.size();
+      uint64_t bits = 0, x;
+      column.resize(rows);
+      for (double& value : column)
+      {
+        data = CompressedColumnWriter::Decode(data, end, x);
+        if (!data) return false;
+        bits ^= x;
+        std::memcpy(&value, &bits, sizeof(value));
+      }
+    }
+    return true;
+  }
+
+  bool NextCsv(std::vector<std::vector<double>>& columns)
+  {
+    std::string line, field;
+    for (size_t r = 0; r < CSV_CHUNK_ROWS && std::getline(file, line); ++r)
+    {
+      std::istringstream fields(line);
+      for (std::vector<double>& column : columns)
+      {
+        std::getline(fields, field, ',');
+        column.push_back(std::strtod(field.c_str(), nullptr));
+      }
+    }
+    return !columns.empty() && !columns[0].empty();
+  }
+};
\ No newline at end of file
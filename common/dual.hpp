@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+// Forward mode automatic differentiation. A Dual carries a value and its derivatives with respect
+// to N parameters, and every operation propagates both, so a model templated on its scalar type
+// computes dC/dθ for all N parameters in the same pass that computes C.
+//
+// Comparisons look at the value only, so branches and step size control take exactly the path
+// the double model takes, and the derivatives are those of that discrete solution.
+template <int N>
+struct Dual
+{
+  double value = 0.0;
+  std::array<double, N> gradient{}; // d value / d parameter
+
+  Dual() = default;
+  Dual(double value) : value(value) {} // Constants have no derivatives
+
+  // The index-th parameter itself, with unit derivative
+  static Dual Variable(double value, int index)
+  {
+    Dual x(value);
+    x.gradient[index] = 1.0;
+    return x;
+  }
+
+  Dual& operator+=(const Dual& b)
+  {
+    value += b.value;
+    for (int p = 0; p < N; ++p) gradient[p] += b.gradient[p];
+    return *this;
+  }
+
+  Dual& operator-=(const Dual& b)
+  {
+    value -= b.value;
+    for (int p = 0; p < N; ++p) gradient[p] -= b.gradient[p];
+    return *this;
+  }
+
+  Dual& operator*=(const Dual& b)
+  {
+    for (int p = 0; p < N; ++p) gradient[p] = gradient[p] * b.value + value * b.gradient[p];
+    value *= b.value;
+    return *this;
+  }
+
+  Dual& operator/=(const Dual& b)
+  {
+    const double inverse = 1.0 / b.value;
+    value /= b.value;
+    for (int p = 0; p < N; ++p) gradient[p] = (gradient[p] - value * b.gradient[p]) * inverse;
+    return *this;
+  }
+
+  // Hidden friends, so doubles convert on either side
+  friend Dual operator+(Dual a, const Dual& b) { return a += b; }
+  friend Dual operator-(Dual a, const Dual& b) { return a -= b; }
+  friend Dual operator*(Dual a, const Dual& b) { return a *= b; }
+  friend Dual operator/(Dual a, const Dual& b) { return a /= b; }
+
+  friend Dual operator-(Dual a)
+  {
+    a.value = -a.value;
+    for (double& g : a.gradient) g = -g;
+    return a;
+  }
+
+  friend bool operator<(const Dual& a, const Dual& b) { return a.value < b.value; }
+  friend bool operator>(const Dual& a, const Dual& b) { return a.value > b.value; }
+  friend bool operator<=(const Dual& a, const Dual& b) { return a.value <= b.value; }
+  friend bool operator>=(const Dual& a, const Dual& b) { return a.value >= b.value; }
+  friend bool operator==(const Dual& a, const Dual& b) { return a.value == b.value; }
+  friend bool operator!=(const Dual& a, const Dual& b) { return a.value != b.value; }
+
+  // f(a) with derivative df at a.value
+  friend Dual Chain(Dual a, double f, double df)
+  {
+    a.value = f;
+    for (double& g : a.gradient) g *= df;
+    return a;
+  }
+
+  friend Dual exp(const Dual& a)
+  {
+    const double e = std::exp(a.value);
+    return Chain(a, e, e);
+  }
+
+  friend Dual log(const Dual& a) { return Chain(a, std::log(a.value), 1.0 / a.value); }
+  friend Dual sqrt(const Dual& a)
+  {
+    const double s = std::sqrt(a.value);
+    return Chain(a, s, 0.5 / s);
+  }
+
+  friend Dual cbrt(const Dual& a)
+  {
+    const double c = std::cbrt(a.value);
+    return Chain(a, c, 1.0 / (3.0 * c * c));
+  }
+
+  friend Dual pow(const Dual& a, double b) { return Chain(a, std::pow(a.value, b), b * std::pow(a.value, b - 1)); }
+  friend Dual abs(const Dual& a) { return a.value < 0 ? -a : a; }
+
+  friend double ValueOf(const Dual& a) { return a.value; }
+};
\ No newline at end of file
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+
+// Persistent threads that run one task split into a fixed number of parts, for loops inside a
+// single simulation step, which are too short to pay for starting threads or queueing tasks.
+// Unlike ThreadPool there is no stealing: part p always runs on the same thread (part 0 on the
+// caller's), so the memory a part works on stays in that core's cache and, placed with FirstTouch,
+// on its NUMA node.
+class ForkJoinPool
+{
+public:
+  static constexpr int SPIN = 4096; // Yields a worker waits for the next task before sleeping
+
+  explicit ForkJoinPool(unsigned parts) : parts(std::max(parts, 1u))
+  {
+    for (unsigned p = 1; p < this->parts; ++p) workers.emplace_back([this, p] { WorkerLoop(p); });
+  }
+
+  ~ForkJoinPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+  }
+
+  ForkJoinPool(const ForkJoinPool&) = delete;
+  ForkJoinPool& operator=(const ForkJoinPool&) = delete;
+
+  unsigned size() const { return parts; }
+
+  // Calls task(part) for every part, each on its own thread, and returns once all have. Rethrows
+  // the first exception a part threw.
+  void Run(const std::function<void(unsigned part)>& task)
+  {
+    this->task = &task;
+    remaining.store(parts - 1, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      generation.fetch_add(1, std::memory_order_release);
+    }
+    wake.notify_all();
+
+    RunPart(0);
+    while (remaining.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+
+    if (error)
+    {
+      std::exception_ptr e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+  // Part part of [begin, end) split in parts, at multiples of a cache line of T from begin so that
+  // no two parts write to the same line
+  template <typename T = double>
+  static std::pair<std::ptrdiff_t, std::ptrdiff_t> Block(std::ptrdiff_t begin, std::ptrdiff_t end, unsigned part, unsigned parts)
+  {
+    constexpr std::ptrdiff_t LINE = std::max<std::ptrdiff_t>(1, 64 / sizeof(T));
+    auto split = [&](unsigned p) {
+      if (p >= parts) return end;
+      return std::min(end, begin + (end - begin) * static_cast<std::ptrdiff_t>(p) / parts / LINE * LINE);
+    };
+    return {split(part), split(part + 1)};
+  }
+
+private:
+  const unsigned parts;
+  std::vector<std::thread> workers;
+  const std::function<void(unsigned)>* task = nullptr;
+
+  std::atomic<unsigned long> generation{0}; // Counts tasks, changed under mutex so sleepers can't miss one
+  std::atomic<unsigned> remaining{0}; // Parts of the current task still running on workers
+
+  std::mutex mutex; // Guards stopping and error
+  std::condition_variable wake;
+  bool stopping = false;
+  std::exception_ptr error;
+
+  void RunPart(unsigned part)
+  {
+    try { (*task)(part); }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) error = std::current_exception();
+    }
+  }
+
+  void WorkerLoop(unsigned part)
+  {
+    unsigned long seen = 0;
+    for (;;)
+    {
+      // Tasks come every few microseconds while a run steps, so spin a while before sleeping
+      unsigned long current = generation.load(std::memory_order_acquire);
+      for (int spin = 0; current == seen && spin < SPIN; ++spin)
+      {
+        std::this_thread::yield();
+        current = generation.load(std::memory_order_acquire);
+      }
+
+      if (current == seen)
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || generation.load(std::memory_order_acquire) != seen; });
+        if (generation.load(std::memory_order_acquire) == seen) return; // Stopping
+        current = generation.load(std::memory_order_acquire);
+      }
+
+      seen = current;
+      RunPart(part);
+      remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+  }
+};
+
+// Moves v to new memory, the elements of each part's range(part) (a [begin, end) pair covering v
+// together with the others) written first by the thread that runs the part. Linux places a page on
+// the NUMA node of the thread that first touches it, so each part then works on local memory.
+template <typename T, typename Range>
+void FirstTouch(FirstTouchVector<T>& v, ForkJoinPool& pool, Range&& range)
+{
+  FirstTouchVector<T> moved;
+  moved.resize(v.size()); // Allocated, not yet touched
+  pool.Run([&](unsigned part) {
+    const auto [begin, end] = range(part);
+    std::copy(v.begin() + begin, v.begin() + end, moved.begin() + begin);
+  });
+  v.swap(moved);
+}
\ No newline at end of file
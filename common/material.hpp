@@ -0,0 +1,206 @@
+#pragma once
+
+#include <array>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "../vendor/nlohmann/json.hpp"
+
+// Material parameters shared by the models, in cm, s and eV. A parameter the material doesn't
+// define is UNSET (NaN), and a model that needs it refuses the material, see Missing.
+//
+// Built in materials (SA304, KOHNERT_EXAMPLE) are constexpr and checked when compiled, and every
+// model defaults to one of them. Others are JSON files of the keys in FIELDS, for example
+//   {"D_0i_cm2_per_s": 0.001, "D_0v_cm2_per_s": 0.6, "E_mi_ev": 0.45, "E_mv_ev": 1.35, ...}
+// The models turn the parameters into their rate tables once, in Init, so a material loaded at
+// run time steps exactly as fast as a built in one.
+struct Material
+{
+  static constexpr double UNSET = std::numeric_limits<double>::quiet_NaN();
+
+  double atomic_volume = UNSET; // cm^3
+  double D_0i = UNSET; // Interstitial diffusion prefactor, cm^2/s
+  double D_0v = UNSET; // Vacancy diffusion prefactor, cm^2/s
+  double E_mi = UNSET; // Interstitial migration energy, eV
+  double E_mv = UNSET; // Vacancy migration energy, eV
+  double r_iv = UNSET; // Interstitial-vacancy recombination radius, cm
+  double r_is = UNSET; // Capture radius of sinks for interstitials, cm
+  double r_vs = UNSET; // Capture radius of sinks for vacancies, cm
+
+  // Cluster binding energy E_b_0 - E_b_capillary (n^2/3 - (n - 1)^2/3), eV
+  double E_b_0 = UNSET;
+  double E_b_capillary = UNSET;
+
+  // Fractions of the cascade defects produced as interstitial and vacancy clusters of 2, 3 and 4
+  double fi2 = UNSET, fi3 = UNSET, fi4 = UNSET;
+  double fv2 = UNSET, fv3 = UNSET, fv4 = UNSET;
+
+  enum class Kind { Positive, Energy, Fraction };
+  struct Field
+  {
+    const char* key;
+    double Material::* value;
+    Kind kind;
+  };
+  static constexpr int NUM_FIELDS = 16;
+  static constexpr std::array<Field, NUM_FIELDS> FIELDS = {{
+    {"atomic_volume_cm3", &Material::atomic_volume, Kind::Positive},
+    {"D_0i_cm2_per_s", &Material::D_0i, Kind::Positive},
+    {"D_0v_cm2_per_s", &Material::D_0v, Kind::Positive},
+    {"E_mi_ev", &Material::E_mi, Kind::Positive},
+    {"E_mv_ev", &Material::E_mv, Kind::Positive},
+    {"r_iv_cm", &Material::r_iv, Kind::Positive},
+    {"r_is_cm", &Material::r_is, Kind::Positive},
+    {"r_vs_cm", &Material::r_vs, Kind::Positive},
+    {"E_b_0_ev", &Material::E_b_0, Kind::Energy},
+    {"E_b_capillary_ev", &Material::E_b_capillary, Kind::Energy},
+    {"fi2", &Material::fi2, Kind::Fraction},
+    {"fi3", &Material::fi3, Kind::Fraction},
+    {"fi4", &Material::fi4, Kind::Fraction},
+    {"fv2", &Material::fv2, Kind::Fraction},
+    {"fv3", &Material::fv3, Kind::Fraction},
+    {"fv4", &Material::fv4, Kind::Fraction},
+  }};
+
+  static constexpr bool IsSet(double value) { return value == value; }
+
+  // The key of the first set parameter that is out of range, or nullptr if there is none:
+  // every length, volume and prefactor positive, the migration energies positive and each set of
+  // cascade fractions in [0, 1] with a sum of at most 1
+  constexpr const char* Problem() const;
+
+  // The key of the first of the fields that is unset, or nullptr if the material defines them all
+  template <typename Fields>
+  const char* Missing(const Fields& fields) const
+  {
+    for (double Material::* field : fields) {
+      if (!IsSet(this->*field)) return Key(field);
+    }
+    return nullptr;
+  }
+
+  static const char* Key(double Material::* field);
+
+  // Reads a material file, throwing std::runtime_error if it is unreadable, has unknown keys or
+  // fails Problem
+  static Material Load(const std::string& path);
+
+  // A built in material by name, or else the file at that path. Each file is read once and then
+  // shared by every model and thread that asks for it.
+  static std::shared_ptr<const Material> Get(const std::string& name);
+};
+
+constexpr const char* Material::Problem() const
+{
+  for (const Field& field : FIELDS)
+  {
+    const double value = this->*field.value;
+    if (!IsSet(value)) continue;
+    if (!(value - value == 0.0)) return field.key; // Infinite
+    if (field.kind == Kind::Positive && !(value > 0.0)) return field.key;
+    if (field.kind == Kind::Fraction && !(value >= 0.0 && value <= 1.0)) return field.key;
+  }
+
+  // Unset fractions count as 0
+  const auto sum = [](double a, double b, double c) { return (IsSet(a) ? a : 0.0) + (IsSet(b) ? b : 0.0) + (IsSet(c) ? c : 0.0); };
+  if (sum(fi2, fi3, fi4) > 1.0) return "fi2";
+  if (sum(fv2, fv3, fv4) > 1.0) return "fv2";
+  return nullptr;
+}
+
+// Austenitic stainless steel, as used by MFRT and CD_Pokor. The cascade fractions are from Table 5
+// of Pokor.
+inline constexpr Material SA304 = [] {
+  Material m;
+  m.D_0i = 0.001;
+  m.D_0v = 0.6;
+  m.E_mi = 0.45;
+  m.E_mv = 1.35;
+  m.r_iv = 0.00000007;
+  m.r_is = 0.0001;
+  m.r_vs = 0.0001;
+  m.fi2 = 0.5;
+  m.fi3 = 0.2;
+  m.fi4 = 0.06;
+  m.fv2 = 0.06;
+  m.fv3 = 0.03;
+  m.fv4 = 0.02;
+  return m;
+}();
+
+// The example case in section 4.4 of the Kohnert paper, as used by CD_Kohnert
+inline constexpr Material KOHNERT_EXAMPLE = [] {
+  Material m;
+  m.atomic_volume = 1.18e-23;
+  m.D_0i = 0.001;
+  m.D_0v = 0.001;
+  m.E_mi = 0.34;
+  m.E_mv = 0.67;
+  m.r_is = 0.0001;
+  m.r_vs = 0.0001;
+  m.E_b_0 = 1.73;
+  m.E_b_capillary = 2.59;
+  return m;
+}();
+
+static_assert(SA304.Problem() == nullptr && KOHNERT_EXAMPLE.Problem() == nullptr, "Built in materials must be valid");
+
+inline constexpr std::array<std::pair<const char*, const Material*>, 2> BUILT_IN_MATERIALS = {{
+  {"SA304", &SA304},
+  {"kohnert_example", &KOHNERT_EXAMPLE},
+}};
+
+inline const char* Material::Key(double Material::* field)
+{
+  for (const Field& f : FIELDS) {
+    if (f.value == field) return f.key;
+  }
+  return "?";
+}
+
+inline Material Material::Load(const std::string& path)
+{
+  std::ifstream file(path);
+  if (!file.good()) throw std::runtime_error("Could not open " + path);
+
+  const nlohmann::json config = nlohmann::json::parse(file);
+  if (!config.is_object()) throw std::runtime_error(path + " must hold an object of material parameters");
+
+  Material material;
+  for (const auto& [key, value] : config.items())
+  {
+    if (key == "name" || key == "description") continue;
+
+    const Field* field = nullptr;
+    for (const Field& f : FIELDS) {
+      if (key == f.key) field = &f;
+    }
+    if (!field) throw std::runtime_error(path + ": unknown material parameter " + key);
+    if (!value.is_number()) throw std::runtime_error(path + ": " + key + " must be a number");
+    material.*(field->value) = value.get<double>();
+  }
+
+  if (const char* bad = material.Problem()) throw std::runtime_error(path + ": " + bad + " is out of range");
+  return material;
+}
+
+inline std::shared_ptr<const Material> Material::Get(const std::string& name)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::shared_ptr<const Material>> materials;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<const Material>& material = materials[name];
+  if (material) return material;
+
+  for (const auto& [built_in, value] : BUILT_IN_MATERIALS) {
+    if (name == built_in) material = std::make_shared<const Material>(*value);
+  }
+  if (!material) material = std::make_shared<const Material>(Load(name));
+  return material;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+
+// Precision policies, for models templated on how they store their state and rate tables and how
+// they add each step's increment to the state. Concentrations span 1e-30 to 1, so a plain update
+// drops every increment below the state's last bit, and a long run of small steps loses them all.
+// A compensated update carries what rounding dropped in a second array and adds it back with the
+// next increment (Neumaier's form of Kahan summation), so the state keeps every increment to the
+// precision of value plus compensation. Arithmetic is in double under every policy.
+
+// Plain double storage and updates, the default
+struct DoublePrecision
+{
+  static constexpr const char* NAME = "double";
+  using Storage = double;
+  static constexpr bool COMPENSATED = false;
+};
+
+// Double storage, with compensated updates
+struct CompensatedPrecision
+{
+  static constexpr const char* NAME = "compensated";
+  using Storage = double;
+  static constexpr bool COMPENSATED = true;
+};
+
+// Float storage, half the memory traffic of double for streaming rate tables and concentrations,
+// with compensated updates so increments still add up to about twice float's precision. Values
+// from 1e-38 up are stored in full, smaller ones lose bits.
+struct SinglePrecision
+{
+  static constexpr const char* NAME = "single";
+  using Storage = float;
+  static constexpr bool COMPENSATED = true;
+};
+
+// value += increment under Policy. compensation holds what rounding has dropped from value so far,
+// value + compensation being the true sum, and is only read or written when Policy::COMPENSATED.
+template <typename Policy, typename T>
+inline void Accumulate(T& value, T& compensation, double increment)
+{
+  if constexpr (!Policy::COMPENSATED) value += increment;
+  else
+  {
+    const double old = value;
+    const double y = increment + compensation;
+    const double sum = old + y;
+    const double dropped = std::abs(old) >= std::abs(y) ? (old - sum) + y : (y - sum) + old;
+
+    value = static_cast<T>(sum);
+    compensation = static_cast<T>(dropped + (sum - static_cast<double>(value))); // And storage's rounding
+  }
+}
+
+// Calls f with a value of the policy called name, returning false if there is none
+template <typename F>
+bool WithPrecision(const std::string& name, F&& f)
+{
+  if (name == DoublePrecision::NAME) f(DoublePrecision{});
+  else if (name == CompensatedPrecision::NAME) f(CompensatedPrecision{});
+  else if (name == SinglePrecision::NAME) f(SinglePrecision{});
+  else return false;
+  return true;
+}
\ No newline at end of file
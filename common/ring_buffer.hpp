@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed capacity queue of rows of Width() values, for exactly one producer thread and one consumer
+// thread. Neither side locks or allocates: each side writes only its own index and reads the
+// other's, caching it so most pushes and pops touch no shared cache line but their own.
+template <typename T>
+class SpscRing
+{
+public:
+  static constexpr size_t CACHE_LINE = 64;
+
+  SpscRing(size_t width, size_t capacity) // capacity in rows
+    : width(width), slots(capacity + 1), values(slots * width)
+  {
+  }
+
+  size_t Width() const { return width; }
+
+  // Copies row in, or returns false if the ring is full. Producer only.
+  bool TryPush(const T* row)
+  {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t next = t + 1 == slots ? 0 : t + 1;
+    if (next == head_seen)
+    {
+      head_seen = head.load(std::memory_order_acquire);
+      if (next == head_seen) return false;
+    }
+
+    std::copy(row, row + width, values.begin() + t * width);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Copies the oldest row out, or returns false if the ring is empty. Consumer only.
+  bool TryPop(T* row)
+  {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail_seen)
+    {
+      tail_seen = tail.load(std::memory_order_acquire);
+      if (h == tail_seen) return false;
+    }
+
+    std::copy(values.begin() + h * width, values.begin() + (h + 1) * width, row);
+    head.store(h + 1 == slots ? 0 : h + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  const size_t width;
+  const size_t slots; // One more than the capacity, so a full ring differs from an empty one
+  std::vector<T> values;
+
+  // The consumer's index and its view of the producer's, then the producer's, on separate lines
+  alignas(CACHE_LINE) std::atomic<size_t> head{0}; // Next row to pop
+  size_t tail_seen = 0;
+  alignas(CACHE_LINE) std::atomic<size_t> tail{0}; // Next slot to push
+  size_t head_seen = 0;
+};
\ No newline at end of file
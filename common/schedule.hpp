@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../vendor/nlohmann/json.hpp"
+
+// Piecewise history of the irradiation conditions, such as a reactor's startup, steady power and
+// outages. Loaded from a JSON list of breakpoints in increasing time:
+//   [{"time": 0, "temperature_kelvin": 300, "dose_rate": 0},
+//    {"time": 3600, "temperature_kelvin": 560, "ramp": true},
+//    {"time": 7200, "dose_rate": 1},
+//    {"time": 90000, "dose_rate": 0}]
+// Each breakpoint sets the quantities it lists from its time on, and the others keep their value.
+// With "ramp": true the listed quantities instead change linearly from the previous breakpoint (or
+// time 0) to this one. Before the first breakpoint, and for quantities never listed, the model's own
+// settings apply.
+//
+// The drivers step exactly onto every breakpoint, so jumps never fall inside a step and the steps
+// between breakpoints can be as long as the solution allows.
+class Schedule
+{
+public:
+  // defaults names every quantity the model accepts, with the value it has without a schedule
+  Schedule(const nlohmann::json& breakpoints, const std::map<std::string, double>& defaults)
+  {
+    for (const auto& [name, value] : defaults)
+    {
+      names.push_back(name);
+      initial.push_back(value);
+    }
+
+    if (!breakpoints.is_array()) throw std::invalid_argument("A schedule must be a list of breakpoints");
+
+    std::vector<double> current = initial;
+    for (const nlohmann::json& b : breakpoints)
+    {
+      Breakpoint point;
+      point.time = b.at("time");
+      point.ramp = b.value("ramp", false);
+      if (!(point.time >= 0.0) || (!points.empty() && point.time <= points.back().time)) {
+        throw std::invalid_argument("Schedule times must be increasing and not negative");
+      }
+
+      for (const auto& [key, value] : b.items())
+      {
+        if (key == "time" || key == "ramp") continue;
+        const int q = Find(key);
+        if (q < 0) throw std::invalid_argument("Unknown schedule quantity " + key);
+        current[q] = value.get<double>();
+      }
+      point.values = current;
+      points.push_back(point);
+    }
+  }
+
+  // Reads a schedule file, holding either the list of breakpoints or an object with it under "schedule"
+  static Schedule Load(const std::string& path, const std::map<std::string, double>& defaults)
+  {
+    std::ifstream file(path);
+    if (!file.good()) throw std::runtime_error("Could not open " + path);
+
+    const nlohmann::json config = nlohmann::json::parse(file);
+    return Schedule(config.is_object() ? config.at("schedule") : config, defaults);
+  }
+
+  // Index of the named quantity, or -1
+  int Find(const std::string& name) const
+  {
+    const auto found = std::find(names.begin(), names.end(), name);
+    return found == names.end() ? -1 : found - names.begin();
+  }
+
+  // Every quantity at time t, in the order of Find
+  void Evaluate(double t, std::vector<double>& values) const
+  {
+    const int b = Segment(t);
+    const std::vector<double>& from = b < 0 ? initial : points[b].values;
+    if (!Ramping(t))
+    {
+      values = from;
+      return;
+    }
+
+    // A ramp to the first breakpoint starts from the model's own settings at time 0
+    const double start = b < 0 ? 0.0 : points[b].time;
+    const Breakpoint& to = points[b + 1];
+    const double s = (t - start) / (to.time - start);
+
+    values.resize(names.size());
+    for (size_t q = 0; q < names.size(); ++q) values[q] = from[q] + s * (to.values[q] - from[q]);
+  }
+
+  // First breakpoint after t, or infinity if there is none
+  double NextBreakpoint(double t) const
+  {
+    const int next = Segment(t) + 1;
+    return next < static_cast<int>(points.size()) ? points[next].time : std::numeric_limits<double>::infinity();
+  }
+
+  // Whether the quantities change continuously at t, so they need updating every step
+  bool Ramping(double t) const
+  {
+    const int next = Segment(t) + 1;
+    return next < static_cast<int>(points.size()) && points[next].ramp;
+  }
+
+private:
+  struct Breakpoint
+  {
+    double time;
+    bool ramp;
+    std::vector<double> values; // Every quantity from this breakpoint on
+  };
+
+  std::vector<std::string> names;
+  std::vector<double> initial;
+  std::vector<Breakpoint> points;
+
+  // Last breakpoint at or before t, -1 before the first
+  int Segment(double t) const
+  {
+    const auto after = std::upper_bound(points.begin(), points.end(), t, [](double t, const Breakpoint& b) { return t < b.time; });
+    return static_cast<int>(after - points.begin()) - 1;
+  }
+};
\ No newline at end of file
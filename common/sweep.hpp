@@ -0,0 +1,81 @@
+#pragma once
+
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../vendor/nlohmann/json.hpp"
+
+// Parameter sweeps, shared by the MFRT and CD drivers.
+//
+// A config with a "sweep" object runs one case per parameter set. Every key outside "sweep" is
+// the base setting for all cases, and the sweep overrides some of them:
+//   "grid": {"key": [values...], ...} runs every combination of the listed values
+//   "cases": [{"key": value, ...}, ...] runs each listed set
+// When both are given, every case is combined with every grid point.
+
+// The parameter sets of a sweep, each a full config with the sweep applied
+inline std::vector<nlohmann::json> ExpandSweep(const nlohmann::json& config)
+{
+  const nlohmann::json& sweep = config.at("sweep");
+
+  nlohmann::json base = config;
+  base.erase("sweep");
+
+  std::vector<nlohmann::json> sets;
+  if (sweep.contains("cases")) {
+    for (const nlohmann::json& c : sweep["cases"])
+    {
+      nlohmann::json set = base;
+      set.update(c);
+      sets.push_back(set);
+    }
+  }
+  else {
+    sets.push_back(base);
+  }
+
+  if (sweep.contains("grid")) {
+    for (const auto& [key, values] : sweep["grid"].items())
+    {
+      if (!values.is_array() || values.empty()) throw std::invalid_argument("Sweep grid entry " + key + " must be a non-empty list");
+
+      std::vector<nlohmann::json> expanded;
+      for (const nlohmann::json& set : sets) {
+        for (const nlohmann::json& value : values)
+        {
+          expanded.push_back(set);
+          expanded.back()[key] = value;
+        }
+      }
+      sets = std::move(expanded);
+    }
+  }
+
+  return sets;
+}
+
+// Keys the sweep varies, in a stable order, to label the cases in the output
+inline std::vector<std::string> SweepKeys(const nlohmann::json& config)
+{
+  const nlohmann::json& sweep = config.at("sweep");
+
+  std::set<std::string> keys;
+  if (sweep.contains("cases")) {
+    for (const nlohmann::json& c : sweep["cases"]) {
+      for (const auto& item : c.items()) keys.insert(item.key());
+    }
+  }
+  if (sweep.contains("grid")) {
+    for (const auto& item : sweep["grid"].items()) keys.insert(item.key());
+  }
+
+  return std::vector<std::string>(keys.begin(), keys.end());
+}
+
+// A parameter value as it should appear in a CSV cell
+inline std::string SweepValue(const nlohmann::json& value)
+{
+  return value.is_string() ? value.get<std::string>() : value.dump();
+}
\ No newline at end of file
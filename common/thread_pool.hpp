@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool. Each worker owns a queue, takes its own work from the back and steals
+// from the front of the others' once it runs dry, so uneven tasks (a stiff case next to an easy
+// one) still keep every core busy.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(unsigned num_threads = std::thread::hardware_concurrency())
+  {
+    if (num_threads == 0) num_threads = 1;
+
+    for (unsigned q = 0; q < num_threads; ++q) queues.push_back(std::make_unique<Queue>());
+    for (unsigned w = 0; w < num_threads; ++w) workers.emplace_back([this, w] { WorkerLoop(w); });
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread& worker : workers) worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  unsigned size() const { return workers.size(); }
+
+  // Queues a task. Tasks submitted from a worker go to its own queue, others are spread round robin.
+  void Submit(std::function<void()> task)
+  {
+    const unsigned q = current_pool == this ? current_worker : next_queue++ % queues.size();
+    {
+      // Counted before it can be popped, so a worker never takes queued or unfinished below zero
+      std::lock_guard<std::mutex> lock(mutex);
+      ++queued;
+      ++unfinished;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queues[q]->mutex);
+      queues[q]->tasks.push_back(std::move(task));
+    }
+    work_available.notify_one();
+  }
+
+  // Blocks until every submitted task has finished. Rethrows the first exception a task threw.
+  void Wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return unfinished == 0; });
+
+    if (error)
+    {
+      std::exception_ptr e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<unsigned> next_queue{0};
+
+  std::mutex mutex; // Guards everything below
+  std::condition_variable work_available;
+  std::condition_variable all_done;
+  size_t queued = 0; // Tasks waiting in a queue
+  size_t unfinished = 0; // Tasks submitted and not yet finished
+  bool stopping = false;
+  std::exception_ptr error;
+
+  static inline thread_local ThreadPool* current_pool = nullptr;
+  static inline thread_local unsigned current_worker = 0;
+
+  bool TryPop(unsigned self, std::function<void()>& task)
+  {
+    {
+      Queue& own = *queues[self];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty())
+      {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+
+    for (size_t offset = 1; offset < queues.size(); ++offset)
+    {
+      Queue& victim = *queues[(self + offset) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WorkerLoop(unsigned index)
+  {
+    current_pool = this;
+    current_worker = index;
+
+    for (;;)
+    {
+      std::function<void()> task;
+      if (TryPop(index, task))
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          --queued;
+        }
+
+        std::exception_ptr task_error;
+        try { task(); }
+        catch (...) { task_error = std::current_exception(); }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (task_error && !error) error = task_error;
+        if (--unfinished == 0) all_done.notify_all();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      work_available.wait(lock, [this] { return stopping || queued > 0; });
+      if (stopping && queued == 0) return;
+    }
+  }
+};
\ No newline at end of file
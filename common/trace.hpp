@@ -0,0 +1,260 @@
+#pragma once
+
+// In-solver instrumentation: phase timers, counters, detections of non-finite values and
+// conservation residuals, exported as a Chrome trace (chrome://tracing or ui.perfetto.dev) and a
+// summary printed at exit.
+//
+// Probes are the MMD_TRACE_* macros below. They compile to nothing, arguments included, unless
+// MMD_TRACE is defined (make TRACE=1), so release builds pay nothing for them.
+//   MMD_TRACE_SCOPE(name)                        times the enclosing block as phase name
+//   MMD_TRACE_COUNT(name, n)                     adds n to counter name
+//   MMD_TRACE_CHECK_FINITE(where, data, n, first) counts non-finite values among data[0..n), reporting
+//                                                the species index of each as first + position
+//   MMD_TRACE_RESIDUAL(name, value)              records a quantity that should stay zero
+//   MMD_TRACE_FINISH(path)                       prints the summary, and writes the trace to path if not empty
+// Names must be string literals. Every thread records into its own log, so probes don't contend.
+
+#ifdef MMD_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Trace
+{
+public:
+  static constexpr size_t MAX_EVENTS = 1 << 20; // Per thread, later phases only go to the summary
+  static constexpr size_t MAX_NON_FINITE = 100; // Per thread, reported with their species index
+
+  static Trace& Instance()
+  {
+    static Trace trace;
+    return trace;
+  }
+
+  int64_t Now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(); }
+
+  void Phase(const char* name, int64_t begin, int64_t end)
+  {
+    Log& log = ThisThread();
+    Total& total = Find(log.phases, name);
+    total.value += end - begin;
+    ++total.calls;
+
+    if (log.events.size() < MAX_EVENTS) log.events.push_back({name, begin, end - begin});
+    else ++log.dropped;
+  }
+
+  void Count(const char* name, long n)
+  {
+    Find(ThisThread().counters, name).value += n;
+  }
+
+  template <typename T>
+  void CheckFinite(const char* where, const T* data, size_t n, long first)
+  {
+    for (size_t i = 0; i < n; ++i)
+    {
+      if (std::isfinite(data[i])) continue;
+
+      Log& log = ThisThread();
+      ++Find(log.counters, "non-finite values").value;
+      if (log.non_finite.size() < MAX_NON_FINITE) log.non_finite.push_back({where, first + static_cast<long>(i), data[i], Now()});
+    }
+  }
+
+  void Residual(const char* name, double value)
+  {
+    Total& total = Find(ThisThread().residuals, name);
+    total.max = std::max(total.max, std::abs(value));
+    ++total.calls;
+  }
+
+  void PrintSummary(std::ostream& out)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::map<std::string, Total> phases, counters, residuals;
+    size_t dropped = 0;
+    for (const auto& log : logs)
+    {
+      Merge(phases, log->phases);
+      Merge(counters, log->counters);
+      Merge(residuals, log->residuals);
+      dropped += log->dropped;
+    }
+
+    out << "Trace summary\n";
+    for (const auto& [name, total] : phases)
+    {
+      out << "  " << std::left << std::setw(28) << name << std::right << std::setw(12) << total.value * 1e-6 << " ms"
+          << std::setw(12) << total.calls << " calls" << std::setw(12) << total.value * 1e-3 / total.calls << " us/call\n";
+    }
+    for (const auto& [name, total] : counters) out << "  " << std::left << std::setw(28) << name << std::right << std::setw(12) << total.value << "\n";
+    for (const auto& [name, total] : residuals) out << "  " << std::left << std::setw(28) << name << std::right << std::setw(12) << total.max << " max |residual| over " << total.calls << "\n";
+    for (const auto& log : logs) {
+      for (const NonFinite& v : log->non_finite) out << "  " << v.value << " in " << v.where << " at species " << v.index << ", " << v.time * 1e-6 << " ms\n";
+    }
+    if (dropped > 0) out << "  " << dropped << " phases past the first " << MAX_EVENTS << " per thread are in the totals only\n";
+  }
+
+  // Complete events for the phases, instant events for non-finite values and the counters as they
+  // stood at the end
+  void WriteChrome(const std::string& path)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::ofstream file(path);
+    if (!file.good())
+    {
+      std::cerr << "Could not open " << path << std::endl;
+      return;
+    }
+
+    file << std::setprecision(15) << "{\"traceEvents\":[\n";
+    const char* separator = "";
+    const int64_t end = Now();
+    for (size_t tid = 0; tid < logs.size(); ++tid)
+    {
+      const Log& log = *logs[tid];
+      for (const Event& e : log.events)
+      {
+        file << separator << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << e.begin * 1e-3 << ",\"dur\":" << e.duration * 1e-3 << "}";
+        separator = ",\n";
+      }
+      for (const NonFinite& v : log.non_finite)
+      {
+        file << separator << "{\"name\":\"non-finite\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << v.time * 1e-3
+             << ",\"args\":{\"where\":\"" << v.where << "\",\"species\":" << v.index << "}}";
+        separator = ",\n";
+      }
+      for (const Total& c : log.counters)
+      {
+        file << separator << "{\"name\":\"" << c.name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << end * 1e-3 << ",\"args\":{\"value\":" << c.value << "}}";
+        separator = ",\n";
+      }
+    }
+    file << "\n]}\n";
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Event
+  {
+    const char* name;
+    int64_t begin, duration; // ns since the trace started
+  };
+
+  struct Total
+  {
+    const char* name = nullptr;
+    int64_t value = 0; // ns for phases
+    long calls = 0;
+    double max = 0.0; // Largest residual
+  };
+
+  struct NonFinite
+  {
+    const char* where;
+    long index;
+    double value;
+    int64_t time;
+  };
+
+  struct Log
+  {
+    std::vector<Event> events;
+    size_t dropped = 0;
+    std::vector<Total> phases, counters, residuals; // Few enough names to search linearly
+    std::vector<NonFinite> non_finite;
+  };
+
+  const Clock::time_point start = Clock::now();
+  std::mutex mutex; // Guards logs
+  std::vector<std::unique_ptr<Log>> logs; // By thread, kept after the thread exits
+
+  Log& ThisThread()
+  {
+    thread_local Log* log = nullptr;
+    if (!log)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      logs.push_back(std::make_unique<Log>());
+      log = logs.back().get();
+    }
+    return *log;
+  }
+
+  static Total& Find(std::vector<Total>& totals, const char* name)
+  {
+    for (Total& t : totals) {
+      if (t.name == name) return t;
+    }
+    totals.push_back({name});
+    return totals.back();
+  }
+
+  // The same literal may have a different address in another translation unit, so merge by text
+  static void Merge(std::map<std::string, Total>& merged, const std::vector<Total>& totals)
+  {
+    for (const Total& t : totals)
+    {
+      Total& m = merged[t.name];
+      m.value += t.value;
+      m.calls += t.calls;
+      m.max = std::max(m.max, t.max);
+    }
+  }
+};
+
+class TraceScope
+{
+public:
+  explicit TraceScope(const char* name) : name(name), begin(Trace::Instance().Now()) {}
+  ~TraceScope() { Trace::Instance().Phase(name, begin, Trace::Instance().Now()); }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  const char* name;
+  int64_t begin;
+};
+
+constexpr bool TRACE_ENABLED = true;
+
+#define MMD_TRACE_CONCAT_(a, b) a##b
+#define MMD_TRACE_CONCAT(a, b) MMD_TRACE_CONCAT_(a, b)
+#define MMD_TRACE_SCOPE(name) TraceScope MMD_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define MMD_TRACE_COUNT(name, n) Trace::Instance().Count(name, n)
+#define MMD_TRACE_CHECK_FINITE(where, data, n, first) Trace::Instance().CheckFinite(where, data, n, first)
+#define MMD_TRACE_RESIDUAL(name, value) Trace::Instance().Residual(name, value)
+#define MMD_TRACE_FINISH(path) \
+  do { \
+    Trace::Instance().PrintSummary(std::cerr); \
+    const std::string trace_path = (path); \
+    if (!trace_path.empty()) Trace::Instance().WriteChrome(trace_path); \
+  } while (0)
+
+#else
+
+constexpr bool TRACE_ENABLED = false;
+
+#define MMD_TRACE_SCOPE(name) ((void)0)
+#define MMD_TRACE_COUNT(name, n) ((void)0)
+#define MMD_TRACE_CHECK_FINITE(where, data, n, first) ((void)0)
+#define MMD_TRACE_RESIDUAL(name, value) ((void)0)
+#define MMD_TRACE_FINISH(path) ((void)0)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+#include "api.hpp"
+
+extern "C" int mmd_abi_version(void)
+{
+  return MMD_ABI_VERSION;
+}
+
+extern "C" const char* mmd_last_error(void)
+{
+  return LastError().c_str();
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <exception>
+#include <string>
+
+#include "mmdinr.h"
+
+// Shared by the model bindings: no exception may cross the C interface, so every entry point that
+// can throw runs its body through Guard, which records what went wrong for mmd_last_error.
+
+inline std::string& LastError()
+{
+  thread_local std::string error;
+  return error;
+}
+
+// Returns body(), or failed if it throws
+template <typename T, typename Body>
+T Guard(T failed, Body&& body)
+{
+  try {
+    return body();
+  }
+  catch (const std::exception& e) {
+    LastError() = e.what();
+  }
+  catch (...) {
+    LastError() = "Unknown error";
+  }
+  return failed;
+}
+
+// Records message and returns MMD_INVALID, for arguments that are refused
+inline int Invalid(const std::string& message)
+{
+  LastError() = message;
+  return MMD_INVALID;
+}
+
+// Records message and returns MMD_FAILED, for steps that went wrong
+inline int Failed(const std::string& message)
+{
+  LastError() = message;
+  return MMD_FAILED;
+}
\ No newline at end of file
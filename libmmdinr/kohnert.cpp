@@ -0,0 +1,105 @@
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include "api.hpp"
+#include "../CD_Kohnert/src/integrator.hpp"
+#include "../CD_Kohnert/src/run.hpp"
+#include "../vendor/nlohmann/json.hpp"
+
+struct mmd_kohnert
+{
+  RunOptions options;
+  std::unique_ptr<CDState> cd;
+  long intervals = 0;
+  double next_dt = 0.0; // Adaptive step to try next
+};
+
+extern "C" mmd_kohnert* mmd_kohnert_create(const char* config_json)
+{
+  return Guard<mmd_kohnert*>(nullptr, [&] {
+    nlohmann::json config = nlohmann::json::parse(config_json);
+    if (config.contains("schedule") || config.value("steady_state", false)) throw std::invalid_argument("schedule and steady_state aren't supported, step and set the conditions instead");
+    if (!config.contains("total_time")) config["total_time"] = 0.0; // The caller decides how far to step
+
+    RunOptions options = ReadOptions(config);
+    options.threads = config.value("threads", options.threads);
+    if (options.precision == SinglePrecision::NAME) throw std::invalid_argument("Single precision is for sweep ensembles only");
+    const std::string problem = CheckOptions(options);
+    if (!problem.empty()) throw std::invalid_argument(problem);
+    if (!(options.dt > 0.0)) throw std::invalid_argument("dt must be positive");
+
+    auto handle = std::make_unique<mmd_kohnert>();
+    handle->options = options;
+    handle->cd = MakeState(options);
+    handle->next_dt = options.dt;
+    return handle.release();
+  });
+}
+
+extern "C" void mmd_kohnert_destroy(mmd_kohnert* model)
+{
+  delete model;
+}
+
+extern "C" int mmd_kohnert_step(mmd_kohnert* model, long n)
+{
+  return Guard<int>(MMD_FAILED, [&] {
+    CDState& cd = *model->cd;
+    const double dt = model->options.dt;
+    for (long s = 0; s < n; ++s)
+    {
+      if (model->options.adaptive)
+      {
+        // The interval ends are recomputed from the count, as for fixed steps
+        const double t_end = (model->intervals + 1) * dt;
+        for (double t = model->intervals * dt; t < t_end;) t = cd.AdaptiveStep(t, t_end, model->next_dt);
+      }
+      else cd.Step(dt);
+      ++model->intervals;
+    }
+
+    for (int i = -cd.state_size; i <= cd.state_size; ++i)
+    {
+      if (!std::isfinite(cd.species.C[i])) return Failed("Non-finite concentration of size " + std::to_string(i));
+    }
+    return static_cast<int>(MMD_OK);
+  });
+}
+
+extern "C" double mmd_kohnert_time(const mmd_kohnert* model)
+{
+  return model->intervals * model->options.dt;
+}
+
+extern "C" int mmd_kohnert_set_temperature(mmd_kohnert* model, double T)
+{
+  if (!(T > 0.0) || !std::isfinite(T)) return Invalid("The temperature must be positive");
+  model->cd->SetTemperature(T);
+  model->cd->GetIntegrator().Restart();
+  return MMD_OK;
+}
+
+extern "C" int mmd_kohnert_set_dose_rate(mmd_kohnert* model, double dose_rate)
+{
+  if (!(dose_rate >= 0.0) || !std::isfinite(dose_rate)) return Invalid("The dose rate must not be negative");
+  model->cd->SetDoseRate(dose_rate);
+  model->cd->GetIntegrator().Restart();
+  return MMD_OK;
+}
+
+extern "C" void mmd_kohnert_restart(mmd_kohnert* model)
+{
+  model->cd->GetIntegrator().Restart();
+}
+
+extern "C" double* mmd_kohnert_concentrations(mmd_kohnert* model, size_t* count)
+{
+  *count = 2 * model->cd->state_size + 1;
+  return model->cd->species.C.data();
+}
+
+extern "C" int mmd_kohnert_state_size(const mmd_kohnert* model)
+{
+  return model->cd->state_size;
+}
\ No newline at end of file
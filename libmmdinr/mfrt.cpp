@@ -0,0 +1,96 @@
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include "api.hpp"
+#include "../MFRT/model.hpp"
+#include "../vendor/nlohmann/json.hpp"
+
+// The model keeps C_i and C_v as separate members, so the handle holds them as one array, which
+// the model is loaded from before stepping and stored back to after
+struct mmd_mfrt
+{
+  MFRTModel model;
+  MFRTParameters parameters; // total_time is one interval, dt
+  MFRTModel::Stepper stepper{0.0}; // The adaptive step and its controller, kept across intervals
+  double C[2] = {0.0, 0.0};
+  long intervals = 0;
+};
+
+extern "C" mmd_mfrt* mmd_mfrt_create(const char* config_json)
+{
+  return Guard<mmd_mfrt*>(nullptr, [&] {
+    const nlohmann::json config = nlohmann::json::parse(config_json);
+
+    auto handle = std::make_unique<mmd_mfrt>();
+    MFRTParameters& p = handle->parameters;
+    p.dt = config.at("dt_seconds");
+    p.temperature = config.at("temperature_kelvin");
+    p.K_0_exp = config.at("K_0_exp");
+    p.C_s_exp = config.at("C_s_exp");
+    p.adaptive = config.value("adaptive", false);
+    p.tolerances.rtol = config.value("rtol", p.tolerances.rtol);
+    p.tolerances.atol = config.value("atol", p.tolerances.atol);
+    const std::string precision = config.value("precision", DoublePrecision::NAME);
+    if (precision != DoublePrecision::NAME && precision != CompensatedPrecision::NAME) throw std::invalid_argument("Unknown precision " + precision + ". Options: double, compensated");
+    p.compensated = precision == CompensatedPrecision::NAME;
+    if (p.compensated && p.adaptive) throw std::invalid_argument("Compensated precision is for fixed steps only");
+    if (config.contains("material"))
+    {
+      p.material = *Material::Get(config["material"].get<std::string>());
+      if (const char* missing = p.material.Missing(MFRTModel::MATERIAL_FIELDS)) throw std::invalid_argument(std::string("The material has no ") + missing);
+    }
+    if (!(p.dt > 0.0)) throw std::invalid_argument("dt_seconds must be positive");
+
+    p.total_time = p.dt;
+    p.sample_interval = p.dt;
+    handle->stepper.dt = p.dt;
+    handle->model.SetMaterial(p.material);
+    return handle.release();
+  });
+}
+
+extern "C" void mmd_mfrt_destroy(mmd_mfrt* model)
+{
+  delete model;
+}
+
+extern "C" int mmd_mfrt_step(mmd_mfrt* model, long n)
+{
+  return Guard<int>(MMD_FAILED, [&] {
+    MFRTModel& m = model->model;
+    m.C_i = model->C[0];
+    m.C_v = model->C[1];
+
+    int status = MMD_OK;
+    for (long s = 0; s < n && status == MMD_OK; ++s)
+    {
+      const MFRTResult result = m.Run(model->parameters, model->stepper, [](double, double, double) {});
+      if (result.status == MFRTStatus::LimitReached) status = Failed("Non-finite concentrations");
+      else if (result.status == MFRTStatus::StepUnderflow) status = Failed("Step size underflow");
+      else ++model->intervals;
+    }
+
+    model->C[0] = m.C_i;
+    model->C[1] = m.C_v;
+    return status;
+  });
+}
+
+extern "C" double mmd_mfrt_time(const mmd_mfrt* model)
+{
+  return model->intervals * model->parameters.dt;
+}
+
+extern "C" int mmd_mfrt_set_temperature(mmd_mfrt* model, double T)
+{
+  if (!(T > 0.0) || !std::isfinite(T)) return Invalid("The temperature must be positive");
+  model->parameters.temperature = T; // Run computes its rates from it
+  return MMD_OK;
+}
+
+extern "C" double* mmd_mfrt_concentrations(mmd_mfrt* model, size_t* count)
+{
+  *count = 2;
+  return model->C;
+}
\ No newline at end of file
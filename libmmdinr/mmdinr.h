@@ -0,0 +1,96 @@
+#pragma once
+
+// C interface to the MFRT, CD_Kohnert and CD_Pokor models, built as libmmdinr.so (see the
+// Makefile). Each model is a handle that is created from a JSON config, stepped any number of
+// times and read in between, then destroyed. Handles are independent, so several can be stepped at
+// once on different threads, but one handle must not be used from two threads at a time.
+//
+// Stepping: mmd_*_step(h, n) advances n intervals of the config's dt. Fixed step configs take one
+// step per interval. Adaptive ones take as many error controlled steps as the tolerances need and
+// land exactly on each interval's end, so every model is read on the same time grid, t = k * dt.
+//
+// Concentrations: mmd_*_concentrations and friends return pointers into the model's own state, no
+// copies. They stay valid until the handle is destroyed, always see the values of the last step,
+// and may be written between steps to change the state. Every array is contiguous float64 in
+// native byte order, so it can be wrapped as it is, e.g. numpy.ctypeslib.as_array(pointer,
+// (count,)) or an Arrow buffer over count * 8 bytes.
+//
+// Errors: functions returning int return MMD_OK or an error status, create returns NULL on failure.
+// mmd_last_error() then describes the last failure on the calling thread.
+
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define MMD_API __attribute__((visibility("default")))
+#else
+#define MMD_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped on any change that breaks callers built against an earlier version
+#define MMD_ABI_VERSION 1
+
+enum
+{
+  MMD_OK = 0,
+  MMD_INVALID = 1, // Bad argument, nothing changed
+  MMD_FAILED = 2   // Integration failed (non-finite concentrations, step size underflow), the state is undefined
+};
+
+MMD_API int mmd_abi_version(void);
+MMD_API const char* mmd_last_error(void); // Empty if nothing failed yet, owned by the library
+
+// Mean field rate theory, the point defect concentrations C_i and C_v. The config takes the keys
+// of MFRT's config.json: dt_seconds, temperature_kelvin, K_0_exp, C_s_exp, and optionally
+// adaptive, rtol, atol, material and precision (double or compensated). Other keys are ignored.
+// Adaptive steps carry their step size from one interval to the next.
+typedef struct mmd_mfrt mmd_mfrt;
+MMD_API mmd_mfrt* mmd_mfrt_create(const char* config_json);
+MMD_API void mmd_mfrt_destroy(mmd_mfrt* model);
+MMD_API int mmd_mfrt_step(mmd_mfrt* model, long n);
+MMD_API double mmd_mfrt_time(const mmd_mfrt* model);
+MMD_API int mmd_mfrt_set_temperature(mmd_mfrt* model, double T);
+// {C_i, C_v}, count 2
+MMD_API double* mmd_mfrt_concentrations(mmd_mfrt* model, size_t* count);
+
+// Cluster dynamics after Kohnert. The config takes the keys of a CD_Kohnert --sweep case: dt, and
+// optionally max_size, group_threshold, group_growth, integrator, adaptive, rtol, atol,
+// temperature_kelvin, C_s, material, lazy_flux, precision (double or compensated) and threads.
+// schedule and steady_state aren't supported.
+typedef struct mmd_kohnert mmd_kohnert;
+MMD_API mmd_kohnert* mmd_kohnert_create(const char* config_json);
+MMD_API void mmd_kohnert_destroy(mmd_kohnert* model);
+MMD_API int mmd_kohnert_step(mmd_kohnert* model, long n);
+MMD_API double mmd_kohnert_time(const mmd_kohnert* model);
+MMD_API int mmd_kohnert_set_temperature(mmd_kohnert* model, double T);
+MMD_API int mmd_kohnert_set_dose_rate(mmd_kohnert* model, double dose_rate); // Relative to the nominal generation
+// Drops the integrator's history, so the next step doesn't reach back across values written into
+// the concentrations. The setters above do this themselves.
+MMD_API void mmd_kohnert_restart(mmd_kohnert* model);
+// Sizes -state_size to state_size, count 2 * state_size + 1, with size i at index i + state_size.
+// Vacancy clusters are negative, interstitial clusters positive, and index state_size (size 0) is
+// unused. state_size is max_size unless size groups are on, when sizes above group_threshold are
+// held per group as described in CD_Kohnert/src/groups.hpp.
+MMD_API double* mmd_kohnert_concentrations(mmd_kohnert* model, size_t* count);
+MMD_API int mmd_kohnert_state_size(const mmd_kohnert* model);
+
+// Cluster dynamics after Pokor, one cell. The config takes dt, and optionally cluster_sizes,
+// adaptive, rtol, atol, temperature_kelvin, dose_rate, material and precision (double or
+// compensated).
+typedef struct mmd_pokor mmd_pokor;
+MMD_API mmd_pokor* mmd_pokor_create(const char* config_json);
+MMD_API void mmd_pokor_destroy(mmd_pokor* model);
+MMD_API int mmd_pokor_step(mmd_pokor* model, long n);
+MMD_API double mmd_pokor_time(const mmd_pokor* model);
+MMD_API int mmd_pokor_set_temperature(mmd_pokor* model, double T);
+MMD_API int mmd_pokor_set_dose_rate(mmd_pokor* model, double dose_rate); // Relative to the nominal G_dpa
+// Interstitial and vacancy clusters, count cluster_sizes, with size n at index n - 1
+MMD_API double* mmd_pokor_interstitials(mmd_pokor* model, size_t* count);
+MMD_API double* mmd_pokor_vacancies(mmd_pokor* model, size_t* count);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
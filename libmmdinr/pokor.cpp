@@ -0,0 +1,119 @@
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include "api.hpp"
+#include "../CD_Pokor/src/cd.hpp"
+#include "../vendor/nlohmann/json.hpp"
+
+struct mmd_pokor
+{
+  explicit mmd_pokor(int num_cluster_sizes) : cd(num_cluster_sizes) {}
+
+  CDState cd;
+  double dt = 0.0;
+  bool adaptive = false;
+  long intervals = 0;
+  double next_dt = 0.0; // Adaptive step to try next
+};
+
+extern "C" mmd_pokor* mmd_pokor_create(const char* config_json)
+{
+  return Guard<mmd_pokor*>(nullptr, [&] {
+    const nlohmann::json config = nlohmann::json::parse(config_json);
+
+    const int num_cluster_sizes = config.value("cluster_sizes", CDState::DEFAULT_NUM_CLUSTER_SIZES);
+    if (num_cluster_sizes < 1) throw std::invalid_argument("cluster_sizes must be at least 1");
+    auto handle = std::make_unique<mmd_pokor>(num_cluster_sizes);
+    CDState& cd = handle->cd;
+
+    handle->dt = config.at("dt");
+    handle->adaptive = config.value("adaptive", false);
+    if (!(handle->dt > 0.0)) throw std::invalid_argument("dt must be positive");
+
+    Tolerances tolerances;
+    tolerances.rtol = config.value("rtol", tolerances.rtol);
+    tolerances.atol = config.value("atol", tolerances.atol);
+
+    Material material = SA304;
+    if (config.contains("material"))
+    {
+      material = *Material::Get(config["material"].get<std::string>());
+      if (const char* missing = material.Missing(CDState::MATERIAL_FIELDS)) throw std::invalid_argument(std::string("The material has no ") + missing);
+    }
+
+    const std::string precision = config.value("precision", DoublePrecision::NAME);
+    if (precision != DoublePrecision::NAME && precision != CompensatedPrecision::NAME) throw std::invalid_argument("Unknown precision " + precision + ". Options: double, compensated");
+    cd.compensated = precision == CompensatedPrecision::NAME;
+    if (cd.compensated && handle->adaptive) throw std::invalid_argument("Compensated precision is for fixed steps");
+
+    cd.T = config.value("temperature_kelvin", cd.T);
+    cd.dose_rate = config.value("dose_rate", cd.dose_rate);
+    cd.SetTolerances(tolerances);
+    cd.SetMaterial(material);
+    cd.Init();
+    handle->next_dt = handle->dt;
+    return handle.release();
+  });
+}
+
+extern "C" void mmd_pokor_destroy(mmd_pokor* model)
+{
+  delete model;
+}
+
+extern "C" int mmd_pokor_step(mmd_pokor* model, long n)
+{
+  return Guard<int>(MMD_FAILED, [&] {
+    CDState& cd = model->cd;
+    const double dt = model->dt;
+    for (long s = 0; s < n; ++s)
+    {
+      if (model->adaptive)
+      {
+        // The interval ends are recomputed from the count, as for fixed steps
+        const double t_end = (model->intervals + 1) * dt;
+        for (double t = model->intervals * dt; t < t_end;) t = cd.AdaptiveStep(t, t_end, model->next_dt);
+      }
+      else cd.Step(dt);
+      ++model->intervals;
+    }
+
+    for (int size = 1; size <= cd.num_cluster_sizes; ++size)
+    {
+      if (!std::isfinite(cd.C_i(size)) || !std::isfinite(cd.C_v(size))) return Failed("Non-finite concentration of size " + std::to_string(size));
+    }
+    return static_cast<int>(MMD_OK);
+  });
+}
+
+extern "C" double mmd_pokor_time(const mmd_pokor* model)
+{
+  return model->intervals * model->dt;
+}
+
+extern "C" int mmd_pokor_set_temperature(mmd_pokor* model, double T)
+{
+  if (!(T > 0.0) || !std::isfinite(T)) return Invalid("The temperature must be positive");
+  model->cd.SetTemperature(T);
+  return MMD_OK;
+}
+
+extern "C" int mmd_pokor_set_dose_rate(mmd_pokor* model, double dose_rate)
+{
+  if (!(dose_rate >= 0.0) || !std::isfinite(dose_rate)) return Invalid("The dose rate must not be negative");
+  model->cd.SetDoseRate(dose_rate);
+  return MMD_OK;
+}
+
+extern "C" double* mmd_pokor_interstitials(mmd_pokor* model, size_t* count)
+{
+  *count = model->cd.num_cluster_sizes;
+  return model->cd.i_concentrations.data();
+}
+
+extern "C" double* mmd_pokor_vacancies(mmd_pokor* model, size_t* count)
+{
+  *count = model->cd.num_cluster_sizes;
+  return model->cd.v_concentrations.data();
+}
\ No newline at end of file